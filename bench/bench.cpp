@@ -0,0 +1,425 @@
+#include "canvas.hpp"
+#include "doublependulum.hpp"
+#include "game_of_life.hpp"
+#include "mat.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace games;
+
+/* usage: bench [--filter=substring] [--min_time=seconds] [--repetitions=n] [--json=file]
+ * results are printed as a table, --json also writes them in the JSON format of Google Benchmark, so its
+ * tools/compare.py can compare two commits: compare.py benchmarks before.json after.json
+ */
+
+namespace
+{
+
+// make the compiler assume value is read and changed, so the work producing it is not optimized away
+template <typename T>
+void keep(T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : "+m"(value) : : "memory");
+#else
+    static volatile char sink;
+    sink = *reinterpret_cast<volatile char *>(&value);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+using runner = std::function<void(int64_t)>; // runs the measured code n times
+
+struct benchmark
+{
+    std::string name;
+    std::function<runner()> setup; // builds the state of a runner, outside the measured time
+    double bytes = 0;              // processed per iteration, for a throughput column
+};
+
+// a benchmark without state to set up
+template <typename F>
+std::function<runner()> plain(F f)
+{
+    return [f] { return runner(f); };
+}
+
+struct result
+{
+    std::string name;
+    int64_t iterations;
+    double real_ns; // per iteration, median over the repetitions
+    double cpu_ns;
+    double bytes_per_second;
+};
+
+struct options
+{
+    std::string filter;
+    std::string json;
+    double min_time = 0.2;
+    int repetitions = 3;
+};
+
+// wall clock and process cpu seconds of running n iterations
+std::pair<double, double> time_run(const runner &run, int64_t n)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    std::clock_t c0 = std::clock();
+    run(n);
+    std::clock_t c1 = std::clock();
+    auto t1 = std::chrono::steady_clock::now();
+    return {std::chrono::duration<double>(t1 - t0).count(), double(c1 - c0) / CLOCKS_PER_SEC};
+}
+
+// grow the iteration count until one run takes min_time, then measure that count repeatedly
+result measure(const benchmark &b, const options &opt)
+{
+    runner run = b.setup();
+    int64_t n = 1;
+    while (true)
+    {
+        double seconds = time_run(run, n).first;
+        if (seconds >= opt.min_time || n >= (int64_t(1) << 40))
+            break;
+        double grow = seconds > 0 ? 1.4 * opt.min_time / seconds : 10;
+        n = std::max(n + 1, static_cast<int64_t>(n * std::min(grow, 10.0)));
+    }
+    std::vector<double> real, cpu;
+    for (int r = 0; r < opt.repetitions; ++r)
+    {
+        auto [wall, proc] = time_run(run, n);
+        real.push_back(wall * 1e9 / n);
+        cpu.push_back(proc * 1e9 / n);
+    }
+    std::sort(real.begin(), real.end());
+    std::sort(cpu.begin(), cpu.end());
+    double median = real[real.size() / 2];
+    return {b.name, n, median, cpu[cpu.size() / 2], b.bytes > 0 ? b.bytes / (median * 1e-9) : 0};
+}
+
+void write_json(const char *path, const std::vector<result> &results, const char *executable, const options &opt)
+{
+    std::FILE *out = std::fopen(path, "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "cannot write %s\n", path);
+        return;
+    }
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+#ifdef NDEBUG
+    const char *build = "release";
+#else
+    const char *build = "debug";
+#endif
+    std::fprintf(out, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"%s\",\n", date, executable);
+    std::fprintf(out, "    \"num_cpus\": %u,\n    \"library_build_type\": \"%s\",\n    \"simd\": \"%s\"\n  },\n",
+                 std::thread::hardware_concurrency(), build,
+                 simd::active_isa() == simd::isa::avx2   ? "avx2"
+                 : simd::active_isa() == simd::isa::sse2 ? "sse2"
+                                                         : "scalar");
+    std::fprintf(out, "  \"benchmarks\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const result &r = results[i];
+        std::fprintf(out,
+                     "    {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", \"repetitions\": %d, "
+                     "\"iterations\": %lld, \"real_time\": %.3f, \"cpu_time\": %.3f, \"time_unit\": \"ns\"",
+                     r.name.c_str(), r.name.c_str(), opt.repetitions, static_cast<long long>(r.iterations), r.real_ns,
+                     r.cpu_ns);
+        if (r.bytes_per_second > 0)
+            std::fprintf(out, ", \"bytes_per_second\": %.0f", r.bytes_per_second);
+        std::fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    std::fclose(out);
+}
+
+void add_math(std::vector<benchmark> &list)
+{
+    list.push_back({"mat4x4f/multiply", plain(
+                                            [](int64_t n)
+                                            {
+                                                mat4x4f a = mat4x4f::identity(), b = mat4x4f::identity();
+                                                a(0, 1) = 0.5f;
+                                                b(2, 3) = -0.25f;
+                                                for (int64_t i = 0; i < n; ++i)
+                                                {
+                                                    keep(a);
+                                                    keep(b);
+                                                    mat4x4f c = a * b;
+                                                    keep(c);
+                                                }
+                                            })});
+    list.push_back({"mat4x4d/multiply", plain(
+                                            [](int64_t n)
+                                            {
+                                                mat4x4d a = mat4x4d::identity(), b = mat4x4d::identity();
+                                                a(0, 1) = 0.5;
+                                                b(2, 3) = -0.25;
+                                                for (int64_t i = 0; i < n; ++i)
+                                                {
+                                                    keep(a);
+                                                    keep(b);
+                                                    mat4x4d c = a * b;
+                                                    keep(c);
+                                                }
+                                            })});
+    list.push_back({"vec3f/norm", plain(
+                                      [](int64_t n)
+                                      {
+                                          vec3f v = {1.0f, 2.0f, 3.0f};
+                                          for (int64_t i = 0; i < n; ++i)
+                                          {
+                                              keep(v);
+                                              float r = v.norm();
+                                              keep(r);
+                                          }
+                                      })});
+    list.push_back({"vec3f/normalized", plain(
+                                            [](int64_t n)
+                                            {
+                                                vec3f v = {1.0f, 2.0f, 3.0f};
+                                                for (int64_t i = 0; i < n; ++i)
+                                                {
+                                                    keep(v);
+                                                    vec3f u = v.normalized();
+                                                    keep(u);
+                                                }
+                                            })});
+}
+
+/* draw(canvas) over and over on an 800 x 600 canvas in immediate mode, so each call is rasterized right away
+ * the tiles it covers stay dirty and are resolved once, after the measurement
+ */
+template <typename F>
+std::function<runner()> primitive(AntiAlias aa, F draw)
+{
+    return [aa, draw]
+    {
+        std::shared_ptr<Canvas> canvas = std::make_shared<Canvas>(800, 600, aa);
+        canvas->beginpaint();
+        canvas->fill(rgb{128, 128, 128});
+        return runner(
+            [canvas, draw](int64_t n)
+            {
+                for (int64_t i = 0; i < n; ++i)
+                {
+                    draw(*canvas);
+                }
+            });
+    };
+}
+
+// every primitive at extents of 16, 128 and 512 pixels, around the center of the canvas
+void add_canvas(std::vector<benchmark> &list)
+{
+    const float cx = 400.5f, cy = 300.5f;
+    for (AntiAlias aa : {AntiAlias::supersample, AntiAlias::coverage})
+    {
+        std::string prefix = aa == AntiAlias::supersample ? "canvas_ss4/" : "canvas_cov/";
+        for (int size : {16, 128, 512})
+        {
+            float r = size / 2.0f;
+            std::string suffix = "/" + std::to_string(size);
+            auto add = [&](const char *name, auto draw) { list.push_back({prefix + name + suffix, primitive(aa, draw)}); };
+            add("fill_circle", [=](Canvas &c) { c.fill(geo2d::circle(cx, cy, r), rgb::red()); });
+            add("draw_circle", [=](Canvas &c) { c.draw(geo2d::circle(cx, cy, r), 3, rgb::red()); });
+            add("fill_circle_alpha",
+                [=](Canvas &c) { c.fill(geo2d::circle(cx, cy, r), rgba::from_opacity(rgb::red(), 0.5)); });
+            add("fill_rect", [=](Canvas &c) { c.fill(geo2d::rect(1.4f * r, 2 * r, cx, cy), rgb::red()); });
+            add("fill_triangle",
+                [=](Canvas &c) { c.fill(geo2d::triangle(cx - r, cy + r, cx + r, cy + r * 0.6f, cx, cy - r), rgb::red()); });
+            add("fill_ellipse", [=](Canvas &c) { c.fill(geo2d::ellipse(cx, cy, r, r * 0.6f, 0.3f), rgb::red()); });
+            // fill(polygon) takes convex polygons only, a regular decagon
+            std::vector<vec2f> decagon;
+            for (int k = 0; k < 10; ++k)
+            {
+                float a = k * 0.6283185f;
+                decagon.push_back(vec2f(cx + r * std::sin(a), cy - r * std::cos(a)));
+            }
+            add("fill_polygon", [=](Canvas &c) { c.fill(geo2d::polygon(decagon), rgb::red()); });
+            geo2d::line diagonal(cx - r, cy - r * 0.3f, cx + r, cy + r * 0.3f);
+            add("draw_hairline", [=](Canvas &c) { c.draw(diagonal, rgb::red()); });
+            add("draw_thick_line", [=](Canvas &c) { c.draw(diagonal, 5, rgb::red()); });
+            geo2d::polyline zigzag({{cx - r, cy}, {cx - r / 2, cy - r / 2}, {cx, cy + r / 2}, {cx + r, cy}});
+            add("draw_polyline",
+                [=](Canvas &c) { c.draw(zigzag, stroke_style{4, LineJoin::round, LineCap::round}, rgb::red()); });
+            std::vector<vec2f> offsets;
+            for (int k = 0; k < 50; ++k)
+            {
+                offsets.push_back(vec2f(r * std::sin(k * 0.7f), r * 0.6f * std::cos(k * 1.3f)));
+            }
+            add("fill_instanced_x50", [=](Canvas &c)
+                { c.fill_instanced(geo2d::circle(cx, cy, 4.5f), offsets, rgba::from_opacity(rgb::red(), 0.7)); });
+        }
+    }
+    // clearing to a new color and publishing it, what every animated example pays per frame
+    list.push_back({"canvas_ss4/clear_endpaint/800x600",
+                    []
+                    {
+                        std::shared_ptr<Canvas> canvas = std::make_shared<Canvas>(800, 600);
+                        return runner(
+                            [canvas](int64_t n)
+                            {
+                                for (int64_t i = 0; i < n; ++i)
+                                {
+                                    canvas->beginpaint();
+                                    canvas->fill(i % 2 ? rgb{128, 128, 128} : rgb{20, 40, 60});
+                                    canvas->endpaint();
+                                }
+                            });
+                    },
+                    4.0 * 800 * 600});
+}
+
+// the box filter behind mean_subpixel, resolving a whole canvas of subpixels
+template <int SN>
+void add_mean_subpixel(std::vector<benchmark> &list, int w, int h)
+{
+    list.push_back({"mean_subpixel/" + std::to_string(SN) + "x/" + std::to_string(w) + "x" + std::to_string(h),
+                    [w, h]
+                    {
+                        std::ptrdiff_t src_stride = simd::row_stride(SN * w);
+                        std::ptrdiff_t dst_stride = simd::row_stride(w);
+                        std::shared_ptr<uint8_t> src(simd::alloc_rows(src_stride * SN * h), simd::free_rows);
+                        std::shared_ptr<uint8_t> dst(simd::alloc_rows(dst_stride * h), simd::free_rows);
+                        for (std::ptrdiff_t i = 0; i < src_stride * SN * h; ++i)
+                        {
+                            src.get()[i] = static_cast<uint8_t>(i * 7);
+                        }
+                        auto scratch = std::make_shared<std::vector<uint16_t>>(simd::box_downsample_scratch<SN>(w));
+                        return runner(
+                            [=](int64_t n)
+                            {
+                                for (int64_t i = 0; i < n; ++i)
+                                {
+                                    simd::box_downsample<SN>(src.get(), src_stride, dst.get(), dst_stride, w, h,
+                                                             scratch->data());
+                                    keep(*dst);
+                                }
+                            });
+                    },
+                    4.0 * SN * SN * w * h});
+}
+
+void add_raster(std::vector<benchmark> &list)
+{
+    add_mean_subpixel<2>(list, 800, 600);
+    add_mean_subpixel<4>(list, 800, 600);
+    add_mean_subpixel<8>(list, 800, 600);
+    for (auto [w, h] : {std::pair{320, 240}, std::pair{800, 600}, std::pair{1920, 1080}})
+    {
+        list.push_back({"raw_fill/" + std::to_string(w) + "x" + std::to_string(h),
+                        [w, h]
+                        {
+                            std::shared_ptr<RawCanvas> canvas = std::make_shared<RawCanvas>(w, h);
+                            return runner(
+                                [canvas](int64_t n)
+                                {
+                                    for (int64_t i = 0; i < n; ++i)
+                                    {
+                                        canvas->fill(static_cast<uint8_t>(i), 128, 64);
+                                    }
+                                });
+                        },
+                        4.0 * w * h});
+    }
+}
+
+void add_simulation(std::vector<benchmark> &list)
+{
+    list.push_back({"game_of_life/step",
+                    []
+                    {
+                        std::shared_ptr<GameOfLife> game = std::make_shared<GameOfLife>(rgb::black(), 1);
+                        return runner(
+                            [game](int64_t n)
+                            {
+                                for (int64_t i = 0; i < n; ++i)
+                                {
+                                    game->step();
+                                    keep(*game);
+                                }
+                            });
+                    }});
+    list.push_back({"double_pendulum/step",
+                    []
+                    {
+                        auto p = std::make_shared<DoublePendulum>(150, 100, 1, 1, rgb::red());
+                        p->start(1.5707963, 1.5707963, 0, 0);
+                        return runner(
+                            [p](int64_t n)
+                            {
+                                for (int64_t i = 0; i < n; ++i)
+                                {
+                                    p->step();
+                                    keep(p->theta1);
+                                }
+                            });
+                    }});
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if (std::strncmp(arg, "--filter=", 9) == 0)
+            opt.filter = arg + 9;
+        else if (std::strncmp(arg, "--json=", 7) == 0)
+            opt.json = arg + 7;
+        else if (std::strncmp(arg, "--min_time=", 11) == 0)
+            opt.min_time = std::atof(arg + 11);
+        else if (std::strncmp(arg, "--repetitions=", 14) == 0)
+            opt.repetitions = std::max(1, std::atoi(arg + 14));
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--filter=substring] [--min_time=seconds] [--repetitions=n] [--json=file]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<benchmark> list;
+    add_math(list);
+    add_canvas(list);
+    add_raster(list);
+    add_simulation(list);
+
+    std::vector<result> results;
+    std::printf("%-40s %14s %14s %12s %10s\n", "benchmark", "time (ns)", "cpu (ns)", "iterations", "GB/s");
+    for (const benchmark &b : list)
+    {
+        if (!opt.filter.empty() && b.name.find(opt.filter) == std::string::npos)
+            continue;
+        result r = measure(b, opt);
+        std::printf("%-40s %14.1f %14.1f %12lld", r.name.c_str(), r.real_ns, r.cpu_ns,
+                    static_cast<long long>(r.iterations));
+        if (r.bytes_per_second > 0)
+            std::printf(" %10.2f", r.bytes_per_second / 1e9);
+        std::printf("\n");
+        std::fflush(stdout);
+        results.push_back(r);
+    }
+    if (!opt.json.empty())
+        write_json(opt.json.c_str(), results, argv[0], opt);
+    return 0;
+}
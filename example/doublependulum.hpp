@@ -0,0 +1,152 @@
+#pragma once
+#ifndef GAMES_DOUBLEPENDULUM_HPP
+#define GAMES_DOUBLEPENDULUM_HPP
+
+#include "canvas.hpp"
+#include "color.hpp"
+#include "util.hpp"
+#include <cmath>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace games
+{
+
+inline void fill_circle(RawCanvas &canvas, int x, int y, int R, rgb color)
+{
+    for (int i = -R; i <= R; ++i)
+    {
+        for (int j = -R; j <= R; ++j)
+        {
+            if (i * i + j * j <= R * R)
+            {
+                canvas.set_pixel(x + i, y + j, color.r, color.g, color.b);
+            }
+        }
+    }
+}
+
+struct DoublePendulum
+{
+    static constexpr double g = 9.8;
+    static constexpr double dt = 0.001;
+    rgb color;
+    double l1;
+    double l2;
+    double m1;
+    double m2;
+    double theta1 = 0;
+    double theta2 = 0;
+    double omega1 = 0;
+    double omega2 = 0;
+    // the state before the last step, drawing interpolates from it
+    double prev_theta1 = 0;
+    double prev_theta2 = 0;
+    std::deque<std::pair<double, double>> trace;
+    std::vector<vec2f> trail; // scratch for the instanced trail
+    DoublePendulum(double l1, double l2, double m1, double m2, rgb color) : color(color), l1(l1), l2(l2), m1(m1), m2(m2)
+    {}
+    void start(double theta1_, double theta2_, double omega1_, double omega2_)
+    {
+        theta1 = theta1_;
+        theta2 = theta2_;
+        omega1 = omega1_;
+        omega2 = omega2_;
+        prev_theta1 = theta1;
+        prev_theta2 = theta2;
+    }
+    std::pair<double, double> solve(double a, double b, double c, double d, double v1, double v2)
+    {
+        double det = a * d - b * c;
+        double num1 = d * v1 - b * v2;
+        double num2 = -c * v1 + a * v2;
+        return {num1 / det, num2 / det};
+    }
+
+    void step()
+    {
+        prev_theta1 = theta1;
+        prev_theta2 = theta2;
+        for (int i = 0; i < 100; ++i)
+        {
+            double a = (m1 + m2) * l1;
+            double b = m2 * l2 * std::cos(theta1 - theta2);
+            double c = m2 * l1 * std::cos(theta1 - theta2);
+            double d = m2 * l2;
+            double v1 = -m2 * l2 * omega2 * omega2 * std::sin(theta1 - theta2) - (m1 + m2) * g * std::sin(theta1);
+            double v2 = m2 * l1 * omega1 * omega1 * std::sin(theta1 - theta2) - m2 * g * std::sin(theta2);
+            auto [d1, d2] = solve(a, b, c, d, v1, v2);
+            omega1 += d1 * dt;
+            omega2 += d2 * dt;
+            theta1 += omega1 * dt;
+            theta2 += omega2 * dt;
+        }
+        trace.push_back({theta1, theta2});
+        if (trace.size() > 50)
+        {
+            trace.pop_front();
+        }
+    }
+    // alpha in [0, 1] places the pendulum between the last two steps
+    void draw(Canvas &canvas, int x, int y, double scale, double alpha = 1)
+    {
+        double R = 10;
+        double t1 = lerp(prev_theta1, theta1, alpha);
+        double t2 = lerp(prev_theta2, theta2, alpha);
+        float x0 = x;
+        float y0 = y;
+        float x1 = x0 + l1 * scale * std::sin(t1);
+        float y1 = y0 + l1 * scale * std::cos(t1);
+        float x2 = x1 + l2 * scale * std::sin(t2);
+        float y2 = y1 + l2 * scale * std::cos(t2);
+        canvas.draw(geo2d::polyline({{x0, y0}, {x1, y1}, {x2, y2}}), stroke_style{1, LineJoin::round, LineCap::square},
+                    rgb{255, 255, 0});
+        canvas.fill(geo2d::circle(x1, y1, R * scale), color);
+        canvas.fill(geo2d::circle(x2, y2, R * scale), color);
+        trail.clear();
+        for (auto &p : trace)
+        {
+            int x1 = x0 + l1 * scale * std::sin(p.first);
+            int y1 = y0 + l1 * scale * std::cos(p.first);
+            int x2 = x1 + l2 * scale * std::sin(p.second);
+            int y2 = y1 + l2 * scale * std::cos(p.second);
+            trail.push_back(vec2f(x2, y2));
+        }
+        canvas.fill_instanced(geo2d::circle(0, 0, R * scale * 0.3), trail, rgba::from_opacity(color, 0.7));
+    }
+
+    // the same with plain pixel lines and circles on a RawCanvas
+    void draw(RawCanvas &canvas, int x, int y, double scale, double alpha = 1)
+    {
+        double R = 10;
+        double t1 = lerp(prev_theta1, theta1, alpha);
+        double t2 = lerp(prev_theta2, theta2, alpha);
+        int x0 = x;
+        int y0 = y;
+        int x1 = x0 + l1 * scale * std::sin(t1);
+        int y1 = y0 + l1 * scale * std::cos(t1);
+        int x2 = x1 + l2 * scale * std::sin(t2);
+        int y2 = y1 + l2 * scale * std::cos(t2);
+        canvas.draw_line(geo2d::line(x0, y0, x1, y1), rgb{255, 255, 0});
+        fill_circle(canvas, x1, y1, R * scale, color);
+        canvas.draw_line(geo2d::line(x1, y1, x2, y2), rgb{255, 255, 0});
+        fill_circle(canvas, x2, y2, R * scale, color);
+        for (auto &p : trace)
+        {
+            int x1 = x0 + l1 * scale * std::sin(p.first);
+            int y1 = y0 + l1 * scale * std::cos(p.first);
+            int x2 = x1 + l2 * scale * std::sin(p.second);
+            int y2 = y1 + l2 * scale * std::cos(p.second);
+            rgb c = color;
+            c.r = c.r * 0.7;
+            c.g = c.g * 0.7;
+            c.b = c.b * 0.7;
+            fill_circle(canvas, x2, y2, R * scale * 0.3, c);
+        }
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_DOUBLEPENDULUM_HPP
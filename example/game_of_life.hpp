@@ -0,0 +1,91 @@
+#pragma once
+#ifndef GAMES_GAME_OF_LIFE_HPP
+#define GAMES_GAME_OF_LIFE_HPP
+
+#include "color.hpp"
+#include "raw_canvas.hpp"
+#include <random>
+
+namespace games
+{
+
+class GameOfLife
+{
+  public:
+    static constexpr int N = 100;
+    static constexpr int M = 100;
+
+  private:
+    bool cells[N][M];
+    bool next[N][M];
+    rgb color;
+    int generation = 0;
+
+  public:
+    GameOfLife(rgb color, unsigned seed = std::random_device{}()) : color(color)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<> dis(0, 1);
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < M; ++j)
+            {
+                cells[i][j] = dis(gen);
+            }
+        }
+    }
+
+    void step()
+    {
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < M; ++j)
+            {
+                int cnt = 0;
+                for (int x = -1; x <= 1; ++x)
+                {
+                    for (int y = -1; y <= 1; ++y)
+                    {
+                        int ni = i + x;
+                        int nj = j + y;
+                        if (unsigned(ni) < unsigned(N) && unsigned(nj) < unsigned(M))
+                            cnt += cells[ni][nj];
+                    }
+                }
+                next[i][j] = cnt == 3 || (cnt == 4 && cells[i][j]);
+            }
+        }
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < M; ++j)
+            {
+                cells[i][j] = next[i][j];
+            }
+        }
+        ++generation;
+    }
+
+    void draw(RawCanvas &canvas, int cell_size)
+    {
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < M; ++j)
+            {
+                if (cells[i][j])
+                {
+                    for (int x = 0; x < cell_size; ++x)
+                    {
+                        for (int y = 0; y < cell_size; ++y)
+                        {
+                            canvas.set_pixel(i * cell_size + x, j * cell_size + y, color.r, color.g, color.b);
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_GAME_OF_LIFE_HPP
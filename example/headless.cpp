@@ -0,0 +1,114 @@
+#include "canvas.hpp"
+#include "headless.hpp"
+#include "profiler.hpp"
+#include "recording.hpp"
+#include "video_sink.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace games;
+
+/* usage: headless [frames] [threads] [output.bmp] [video]
+ * 0 frames renders uncapped for 5 seconds, video is a .y4m or raw .rgb file, a .grec recording, or - for y4m on
+ * stdout
+ * for example: headless 600 8 last.bmp - | ffmpeg -i - out.mp4
+ * GAMES_PROFILE=1 reports the time spent in each phase of a frame on exit, GAMES_TRACE=trace.json writes a timeline
+ */
+int main(int argc, char **argv)
+{
+    const int width = 800;
+    const int height = 600;
+    int frames = argc > 1 ? std::atoi(argv[1]) : 600;
+    int threads = argc > 2 ? std::atoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+    if (prof::enable_from_env())
+        prof::report_at_exit();
+    prof::set_thread_name("producer");
+
+    Canvas canvas(width, height);
+    canvas.set_threads(threads);
+    canvas.set_deferred(threads > 1);
+    HeadlessDriver driver(canvas.get_raw_canvas());
+    std::unique_ptr<VideoSink> video;
+    std::unique_ptr<FrameRecorder> recording;
+    if (argc > 4)
+    {
+        std::string path = argv[4];
+        auto ends_with = [&](std::string ext)
+        { return path.size() > ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0; };
+        if (ends_with(".grec"))
+        {
+            recording = std::make_unique<FrameRecorder>(argv[4]);
+            canvas.get_raw_canvas().set_sink(recording.get());
+        }
+        else
+        {
+            video = std::make_unique<VideoSink>(argv[4], ends_with(".rgb") ? VideoFormat::rgb24 : VideoFormat::y4m);
+            canvas.get_raw_canvas().set_sink(video.get());
+        }
+    }
+
+    const rgb colors[3] = {{255, 0, 0}, {0, 255, 0}, {0, 0, 255}};
+    std::vector<vec2f> trail;
+    auto frame = [&](int i)
+    {
+        canvas.beginpaint();
+        {
+            ScopedTimer timer(Phase::draw);
+            canvas.fill(rgb{128, 128, 128});
+            float x0 = width / 2.0f;
+            float y0 = height / 4.0f;
+            for (int k = 0; k < 3; ++k)
+            {
+                auto arm = [&](int j)
+                {
+                    float t = (i - j) * 0.02f;
+                    float a1 = 1.5f * std::sin(t + k * 0.1f);
+                    float a2 = 2.5f * std::sin(1.7f * t + k * 0.3f);
+                    vec2f p1(x0 + 225 * std::sin(a1), y0 + 225 * std::cos(a1));
+                    vec2f p2(p1[0] + 150 * std::sin(a2), p1[1] + 150 * std::cos(a2));
+                    return std::pair{p1, p2};
+                };
+                auto [p1, p2] = arm(0);
+                canvas.draw(geo2d::polyline({{x0, y0}, p1, p2}), stroke_style{1, LineJoin::round, LineCap::square},
+                            rgb{255, 255, 0});
+                canvas.fill(geo2d::circle(p1[0], p1[1], 15), colors[k]);
+                canvas.fill(geo2d::circle(p2[0], p2[1], 15), colors[k]);
+                trail.clear();
+                for (int j = 1; j <= 50; ++j)
+                {
+                    trail.push_back(arm(j).second);
+                }
+                canvas.fill_instanced(geo2d::circle(0, 0, 4.5), trail, rgba::from_opacity(colors[k], 0.7));
+            }
+        }
+        canvas.endpaint();
+    };
+
+    auto stats = frames > 0 ? driver.run(frame, frames) : driver.run_for(frame, 5.0);
+    // stdout may carry the video
+    std::cerr << stats.frames << " frames in " << stats.seconds << " s, " << stats.fps() << " fps" << std::endl;
+    if (argc > 3 && std::string(argv[3]) != "-")
+        canvas.save_bmp(argv[3]);
+    if (video && !video->ok())
+    {
+        std::cerr << "writing the video failed" << std::endl;
+        return 1;
+    }
+    if (recording)
+    {
+        recording->close();
+        if (!recording->ok())
+        {
+            std::cerr << "writing the recording failed" << std::endl;
+            return 1;
+        }
+        std::cerr << recording->frames() << " frames recorded in " << recording->bytes() << " bytes" << std::endl;
+    }
+    return 0;
+}
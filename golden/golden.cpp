@@ -0,0 +1,462 @@
+#include "canvas.hpp"
+#include "doublependulum.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace games;
+
+/* usage: golden [--dir=path] [--filter=substring] [--tolerance=n] [--max_slowdown=x] [--images] [--timing] [--update]
+ * every scene is rendered with both anti-aliasing modes, each in immediate mode, deferred mode and deferred mode on
+ * 4 threads, saved with save_bmp and compared with the reference <dir>/<scene>_<aa>.bmp, a channel may differ by
+ * tolerance; images that do not match are kept in the working directory as <scene>_<aa>_<mode>.actual.bmp
+ * the best render time of each is taken relative to a fixed calibration loop, so the baseline in <dir>/timings.txt
+ * carries over to faster or slower machines, a ratio max_slowdown times the baseline fails; baselines recorded with
+ * another SIMD instruction set, and those of the threaded mode on fewer than 4 hardware threads, are only reported
+ * --update writes the references and the timings of the current build instead of comparing with them
+ * exits with 0 when everything passed, 1 on a mismatch or slowdown and 77 when timing an unoptimized build
+ */
+
+namespace
+{
+
+constexpr int WIDTH = 200; // not a multiple of the tile size, so partial tiles are covered too
+constexpr int HEIGHT = 130;
+constexpr int SKIPPED = 77; // ctest SKIP_RETURN_CODE
+
+struct scene
+{
+    const char *name;
+    std::function<void(Canvas &)> render; // one or more complete frames, from beginpaint to endpaint
+};
+
+struct mode
+{
+    const char *name;
+    bool deferred;
+    int threads;
+};
+
+const mode modes[] = {{"immediate", false, 1}, {"deferred", true, 1}, {"threads", true, 4}};
+
+struct options
+{
+    std::string dir = ".";
+    std::string filter;
+    int tolerance = 1;
+    double max_slowdown = 2.0;
+    bool images = true;
+    bool timing = true;
+    bool update = false;
+};
+
+void shapes(Canvas &c)
+{
+    c.beginpaint();
+    c.fill(rgb{30, 30, 40});
+    c.fill(geo2d::circle(40.3f, 40.7f, 27.5f), rgb{220, 60, 50});
+    c.fill(geo2d::circle(12, 118, 1.4f), rgb::light_white());
+    c.fill(geo2d::triangle(80, 10, 130, 25, 95, 70), rgb{60, 200, 90});
+    c.fill(geo2d::rect(30, 60, 160, 40, 0.4f), rgb{70, 110, 230});
+    c.fill(geo2d::ellipse(60, 100, 40, 15, -0.3f), rgb{240, 200, 40});
+    // fill(polygon) takes convex polygons, a slightly irregular heptagon
+    std::vector<vec2f> heptagon;
+    for (int k = 0; k < 7; ++k)
+    {
+        float a = k * 0.8975979f + 0.2f;
+        float r = k % 2 ? 26.0f : 30.0f;
+        heptagon.push_back(vec2f(150 + r * std::sin(a), 95 - r * std::cos(a)));
+    }
+    c.fill(geo2d::polygon(heptagon), rgb{200, 80, 220});
+    // crossing the right and bottom edges
+    c.fill(geo2d::circle(195, 125, 20), rgb{90, 220, 220});
+    c.endpaint();
+}
+
+void strokes(Canvas &c)
+{
+    c.beginpaint();
+    c.fill(rgb{240, 240, 235});
+    c.draw(geo2d::circle(35, 35, 25), 4, rgb{200, 40, 40});
+    c.draw(geo2d::circle(35, 35, 10), 1.5f, rgb{40, 40, 200});
+    c.draw(geo2d::ellipse(110, 30, 40, 14, 0.5f), 3, rgb{20, 140, 60});
+    for (int k = 0; k < 12; ++k)
+    {
+        float a = k * 0.2617994f;
+        c.draw(geo2d::line(170, 10, 170 + 28 * std::cos(a), 10 + 28 * std::sin(a)), rgb{30, 30, 30});
+    }
+    c.draw(geo2d::line(5, 70, 190, 62), 6, rgb{230, 120, 20});
+    c.draw(geo2d::line(10, 125, 60, 80), 2.5f, rgb{120, 30, 160});
+    const LineJoin joins[] = {LineJoin::miter, LineJoin::round, LineJoin::bevel};
+    const LineCap caps[] = {LineCap::butt, LineCap::square, LineCap::round};
+    for (int k = 0; k < 3; ++k)
+    {
+        float x = 75 + 42 * k;
+        c.draw(geo2d::polyline({{x, 120}, {x + 12, 85}, {x + 22, 112}, {x + 34, 90}}), stroke_style{5, joins[k], caps[k]},
+               rgb{20, 90, 200});
+    }
+    c.draw(geo2d::polyline({{150, 40}, {190, 45}, {175, 58}}, true), stroke_style{3, LineJoin::miter, LineCap::butt},
+           rgb{200, 20, 120});
+    c.endpaint();
+}
+
+void blending(Canvas &c)
+{
+    c.beginpaint();
+    c.fill(rgb{20, 20, 20});
+    c.fill(geo2d::circle(60, 55, 40), rgba::from_opacity(rgb{255, 0, 0}, 0.6));
+    c.fill(geo2d::circle(90, 55, 40), rgba::from_opacity(rgb{0, 255, 0}, 0.6));
+    c.fill(geo2d::circle(75, 85, 40), rgba::from_opacity(rgb{0, 0, 255}, 0.6));
+    c.fill(geo2d::circle(150, 50, 30), rgba::from_opacity(rgb{255, 120, 0}, 0.5), BlendMode::additive);
+    c.fill(geo2d::circle(165, 70, 30), rgba::from_opacity(rgb{0, 120, 255}, 0.5), BlendMode::additive);
+    c.fill(geo2d::rect(20, 180, 100, 115, -0.2f), rgba::from_opacity(rgb::light_white(), 0.3));
+    c.fill(geo2d::triangle(120, 125, 195, 125, 160, 95), rgba::from_opacity(rgb{255, 255, 0}, 0.4));
+    c.draw(geo2d::line(0, 0, 200, 130), 4, rgba::from_opacity(rgb{255, 0, 255}, 0.5));
+    c.draw(geo2d::line(0, 130, 200, 0), rgba::from_opacity(rgb::light_white(), 0.7));
+    c.draw(geo2d::ellipse(100, 65, 80, 50, 0.1f), 2, rgba::from_opacity(rgb{0, 255, 255}, 0.5));
+    c.endpaint();
+}
+
+void instanced(Canvas &c)
+{
+    std::vector<vec2f> offsets;
+    for (int k = 0; k < 60; ++k)
+    {
+        offsets.push_back(vec2f(100 + 85 * std::sin(k * 0.37f), 65 + 55 * std::cos(k * 0.61f)));
+    }
+    c.beginpaint();
+    c.fill(rgb{10, 30, 50});
+    c.fill_instanced(geo2d::circle(0.25f, 0.5f, 4.5f), offsets, rgb{250, 220, 120});
+    c.fill_instanced(geo2d::circle(3, -2, 2.2f), offsets, rgba::from_opacity(rgb{120, 200, 255}, 0.7));
+    c.draw_instanced(geo2d::circle(0, 0, 8), 1.5f, std::span<const vec2f>(offsets).first(20), rgb{255, 90, 90});
+    c.endpaint();
+}
+
+// later frames repaint part of the canvas only, the rest has to be carried over from the frames before
+void frames(Canvas &c)
+{
+    c.beginpaint();
+    c.fill(rgb{50, 50, 50});
+    c.fill(geo2d::circle(50, 50, 30), rgb{200, 200, 0});
+    c.endpaint();
+    c.beginpaint();
+    c.fill(geo2d::rect(40, 40, 150, 90), rgb{0, 150, 200});
+    c.endpaint();
+    c.beginpaint();
+    c.fill(rgb{90, 20, 20});
+    c.fill(geo2d::circle(100, 65, 20), rgba::from_opacity(rgb::light_white(), 0.5));
+    c.endpaint();
+    c.beginpaint();
+    c.draw(geo2d::line(10, 10, 190, 120), 3, rgb{0, 255, 120});
+    c.endpaint();
+}
+
+// the double pendulum example, stepped ahead while the scene list is built so only drawing is timed
+std::function<void(Canvas &)> pendulum()
+{
+    static constexpr double pi = 3.14159265358979323846;
+    DoublePendulum p1(150, 100, 1, 1, rgb{255, 0, 0});
+    DoublePendulum p2(150, 100, 1, 1, rgb{0, 255, 0});
+    p1.start(pi / 2, pi / 2, 0, 0);
+    p2.start(pi / 2, pi / 2, 0, 0.01);
+    for (int i = 0; i < 120; ++i)
+    {
+        p1.step();
+        p2.step();
+    }
+    return [p1, p2](Canvas &c)
+    {
+        DoublePendulum q1 = p1, q2 = p2;
+        c.beginpaint();
+        c.fill(rgb::black());
+        q1.draw(c, WIDTH / 2, HEIGHT / 3, 0.25, 0.5);
+        q2.draw(c, WIDTH / 2, HEIGHT / 3, 0.25, 0.5);
+        c.endpaint();
+    };
+}
+
+std::vector<scene> scenes()
+{
+    return {{"shapes", shapes},
+            {"strokes", strokes},
+            {"blending", blending},
+            {"instanced", instanced},
+            {"frames", frames},
+            {"pendulum", pendulum()}};
+}
+
+struct image
+{
+    std::vector<uint8_t> pixels; // tightly packed BGRX
+    int width = 0;
+    int height = 0;
+};
+
+// compares the color channels, returns the number of pixels off by more than tolerance
+int compare(const image &a, const image &b, int tolerance, int &max_diff)
+{
+    max_diff = 0;
+    int bad = 0;
+    for (std::size_t i = 0; i < a.pixels.size(); i += simd::PIXEL_BYTES)
+    {
+        int d = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            d = std::max(d, std::abs(a.pixels[i + k] - b.pixels[i + k]));
+        }
+        max_diff = std::max(max_diff, d);
+        bad += d > tolerance;
+    }
+    return bad;
+}
+
+// best time per call of f in microseconds, of 5 batches lasting 10 ms or more each
+template <typename F>
+double best_time(F &&f)
+{
+    using clock = std::chrono::steady_clock;
+    int n = 1;
+    double best = 1e300;
+    for (int batch = 0; batch < 5;)
+    {
+        clock::time_point begin = clock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            f();
+        }
+        double us = std::chrono::duration<double, std::micro>(clock::now() - begin).count();
+        if (us < 10000 && n < (1 << 20))
+        {
+            n *= 2;
+            continue;
+        }
+        best = std::min(best, us / n);
+        ++batch;
+    }
+    return best;
+}
+
+// make the compiler assume value is read and changed, so the work producing it is not optimized away
+template <typename T>
+void keep(T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : "+m"(value) : : "memory");
+#else
+    static volatile char sink;
+    sink = *reinterpret_cast<volatile char *>(&value);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// scalar arithmetic and stores into a buffer the size of a few tiles, the unit render times are measured in
+void calibration()
+{
+    static std::vector<float> buffer(1 << 14);
+    float x = 0.5f;
+    for (int pass = 0; pass < 8; ++pass)
+    {
+        for (float &v : buffer)
+        {
+            x = x * 0.999f + 0.37f;
+            v = std::sqrt(v + x);
+        }
+        keep(buffer[pass]);
+    }
+}
+
+const char *isa_name()
+{
+    switch (simd::active_isa())
+    {
+        case simd::isa::avx2: return "avx2";
+        case simd::isa::sse2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// render time over calibration time per scene and mode, and the instruction set they were measured with
+struct timings
+{
+    std::string isa;
+    std::map<std::string, double> ratio;
+};
+
+timings read_timings(const std::string &path)
+{
+    timings t;
+    std::FILE *in = std::fopen(path.c_str(), "r");
+    if (!in)
+        return t;
+    char line[256], key[200];
+    double ratio;
+    while (std::fgets(line, sizeof(line), in))
+    {
+        if (std::sscanf(line, "# isa %199s", key) == 1)
+            t.isa = key;
+        else if (line[0] != '#' && std::sscanf(line, "%199s %lf", key, &ratio) == 2)
+            t.ratio[key] = ratio;
+    }
+    std::fclose(in);
+    return t;
+}
+
+bool write_timings(const std::string &path, const timings &t)
+{
+    std::FILE *out = std::fopen(path.c_str(), "w");
+    if (!out)
+        return false;
+    std::fprintf(out, "# best render time over the calibration loop time, written by golden --update\n");
+    std::fprintf(out, "# isa %s\n", t.isa.c_str());
+    for (const auto &[key, ratio] : t.ratio)
+    {
+        std::fprintf(out, "%s %.4f\n", key.c_str(), ratio);
+    }
+    return std::fclose(out) == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    options opt;
+    bool only_images = false, only_timing = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if (std::strncmp(arg, "--dir=", 6) == 0)
+            opt.dir = arg + 6;
+        else if (std::strncmp(arg, "--filter=", 9) == 0)
+            opt.filter = arg + 9;
+        else if (std::strncmp(arg, "--tolerance=", 12) == 0)
+            opt.tolerance = std::atoi(arg + 12);
+        else if (std::strncmp(arg, "--max_slowdown=", 15) == 0)
+            opt.max_slowdown = std::atof(arg + 15);
+        else if (std::strcmp(arg, "--images") == 0)
+            only_images = true;
+        else if (std::strcmp(arg, "--timing") == 0)
+            only_timing = true;
+        else if (std::strcmp(arg, "--update") == 0)
+            opt.update = true;
+        else
+        {
+            std::fprintf(stderr,
+                         "usage: %s [--dir=path] [--filter=substring] [--tolerance=n] [--max_slowdown=x] [--images] "
+                         "[--timing] [--update]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+    if (only_images != only_timing)
+    {
+        opt.images = only_images;
+        opt.timing = only_timing;
+    }
+#ifndef NDEBUG
+    if (opt.timing && !opt.images)
+    {
+        std::printf("timing skipped, the build is not optimized\n");
+        return SKIPPED;
+    }
+    opt.timing = false;
+#endif
+
+    const std::string timings_path = opt.dir + "/timings.txt";
+    const timings baseline = read_timings(timings_path);
+    timings measured = baseline;
+    measured.isa = isa_name();
+    const bool same_isa = baseline.isa == measured.isa;
+    const bool enough_threads = std::thread::hardware_concurrency() >= 4;
+    double unit = 0;
+    if (opt.timing)
+    {
+        unit = best_time(calibration);
+        std::printf("     calibration %.1f us, isa %s\n", unit, measured.isa.c_str());
+        if (!opt.update && !same_isa)
+            std::printf("     baseline recorded with isa %s, timings are only reported\n", baseline.isa.c_str());
+    }
+    int failed = 0;
+    for (const scene &s : scenes())
+    {
+        if (!opt.filter.empty() && std::string(s.name).find(opt.filter) == std::string::npos)
+            continue;
+        for (AntiAlias aa : {AntiAlias::supersample, AntiAlias::coverage})
+        {
+            const std::string name = std::string(s.name) + (aa == AntiAlias::supersample ? "_ss4" : "_cov");
+            const std::string reference_path = opt.dir + "/" + name + ".bmp";
+            image reference;
+            if (opt.images && !opt.update &&
+                !read_bmp(reference_path.c_str(), reference.pixels, reference.width, reference.height))
+            {
+                std::printf("FAIL %-28s no reference %s\n", name.c_str(), reference_path.c_str());
+                ++failed;
+                continue;
+            }
+            for (const mode &m : modes)
+            {
+                const std::string key = name + "/" + m.name;
+                Canvas canvas(WIDTH, HEIGHT, aa);
+                canvas.set_deferred(m.deferred);
+                canvas.set_threads(m.threads);
+                s.render(canvas);
+                if (opt.images && opt.update && !m.deferred)
+                {
+                    canvas.save_bmp(reference_path.c_str());
+                    read_bmp(reference_path.c_str(), reference.pixels, reference.width, reference.height);
+                }
+                else if (opt.images)
+                {
+                    const std::string actual_path = name + "_" + m.name + ".actual.bmp";
+                    canvas.save_bmp(actual_path.c_str());
+                    image actual;
+                    int max_diff = 0, bad = -1;
+                    if (read_bmp(actual_path.c_str(), actual.pixels, actual.width, actual.height) &&
+                        actual.width == reference.width && actual.height == reference.height)
+                        bad = compare(actual, reference, opt.tolerance, max_diff);
+                    if (bad == 0)
+                        std::remove(actual_path.c_str());
+                    else
+                    {
+                        std::printf("FAIL %-28s %d pixels differ by up to %d, see %s\n", key.c_str(), bad, max_diff,
+                                    actual_path.c_str());
+                        ++failed;
+                    }
+                }
+                if (!opt.timing)
+                    continue;
+                double us = best_time([&] { s.render(canvas); });
+                double ratio = us / unit;
+                measured.ratio[key] = ratio;
+                auto it = baseline.ratio.find(key);
+                if (opt.update || it == baseline.ratio.end())
+                    std::printf("     %-28s %10.1f us %8.4f\n", key.c_str(), us, ratio);
+                else
+                {
+                    bool enforced = same_isa && (m.threads == 1 || enough_threads);
+                    bool slow = enforced && ratio > opt.max_slowdown * it->second;
+                    std::printf("%s %-28s %10.1f us %8.4f, baseline %8.4f, %5.2fx%s\n", slow ? "FAIL" : "    ",
+                                key.c_str(), us, ratio, it->second, ratio / it->second, enforced ? "" : " (reported)");
+                    failed += slow;
+                }
+            }
+        }
+    }
+    if (opt.update && opt.timing && !write_timings(timings_path, measured))
+    {
+        std::printf("FAIL could not write %s\n", timings_path.c_str());
+        ++failed;
+    }
+    std::printf("%s\n", failed ? "failed" : "passed");
+    return failed ? 1 : 0;
+}
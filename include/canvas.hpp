@@ -4,220 +4,1992 @@
 
 #include "color.hpp"
 #include "geometry2d.hpp"
-#include "window.hpp"
+#include "lines.hpp"
+#include "profiler.hpp"
+#include "raw_canvas.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include <array>
+#include <bit>
+#include <limits>
+#include <memory>
 #include <numbers>
+#include <span>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 namespace games
 {
 
-class Canvas
+enum class AntiAlias
 {
+    supersample, // rasterize into an SN x SN subpixel buffer, then box filter
+    coverage,    // compute per-pixel coverage analytically, no subpixel buffer
+};
+
+enum class LineJoin
+{
+    miter, // falls back to bevel beyond the miter limit
+    round,
+    bevel,
+};
+
+enum class LineCap
+{
+    butt,
+    square, // extended by half the width
+    round,
+};
+
+struct stroke_style
+{
+    float width = 1;
+    LineJoin join = LineJoin::miter;
+    LineCap cap = LineCap::butt;
+    float miter_limit = 4; // longest miter over the width, as in SVG
+};
+
+/* SN x SN samples per pixel, fixed at compile time: 1 (no AA), 2, 4 or 8
+ * subpixels are stored BGRX in padded rows like RawCanvas, with SN == 1 they are the RawCanvas pixels themselves
+ */
+template <int SN>
+class BasicCanvas
+{
+    static_assert(SN == 1 || SN == 2 || SN == 4 || SN == 8, "SN must be 1, 2, 4 or 8");
+
   private:
     RawCanvas m_canvas;
+    AntiAlias m_aa;
 
-    static constexpr int SN = 4;
     uint8_t *m_subpixels;
 
-    uint8_t *sp_at(int x, int y) { return m_subpixels + 3 * (y * width() * SN + x); }
+    // the canvas is split into TILE x TILE pixel tiles, only tiles changed since the last endpaint are resolved
+    static constexpr int TILE = 32;
+    struct tile_state
+    {
+        bool cleared; // the whole tile is m_clear, nothing written to the backing store yet
+        bool dirty;   // changed since the last endpaint
+        rgb clear;
+    };
+    int m_tiles_x;
+    int m_tiles_y;
+    std::vector<tile_state> m_tiles;
+    using region = RawCanvas::region;
+    std::vector<region> m_damage;
+    // beginpaint was called and the back buffer of the RawCanvas has not caught up with the last frame yet
+    bool m_catch_up = false;
+
+    std::unique_ptr<ThreadPool> m_pool;
+
+    uint8_t *sp_at(int x, int y)
+    {
+        if constexpr (SN == 1)
+            return m_canvas.raw_pixel(x, y);
+        else
+            return m_subpixels + y * sp_stride() + simd::PIXEL_BYTES * x;
+    }
     int sp_width() const { return SN * width(); }
     int sp_height() const { return SN * height(); }
-    void set_subpixel(int x, int y, rgb color)
+    std::ptrdiff_t sp_stride() const { return SN == 1 ? m_canvas.stride() : simd::row_stride(sp_width()); }
+    // whether drawn tiles have to be downsampled into the RawCanvas
+    bool has_subpixels() const { return SN > 1 && m_aa == AntiAlias::supersample; }
+    // how a primitive writes its pixels: opaque stores, or a premultiplied color blended with mode
+    struct paint
+    {
+        uint8_t bgrx[4]; // memory order of the pixels
+        uint8_t a;
+        BlendMode mode;
+
+        paint(rgb c) : bgrx{c.b, c.g, c.r, 0}, a(255), mode(BlendMode::src_over) {}
+        paint(rgba c, BlendMode m) : bgrx{c.b, c.g, c.r, 0}, a(c.a), mode(m) {}
+        bool opaque() const { return mode == BlendMode::src_over && a == 255; }
+    };
+
+    // n pixels from p, opaque spans are plain vector stores of the pixel
+    static void write_span(uint8_t *p, int n, const paint &color)
+    {
+        if (n <= 0)
+            return;
+        if (!color.opaque())
+            return simd::blend_span(p, n, color.bgrx, color.a, color.mode);
+        simd::fill_span(p, n, color.bgrx);
+    }
+
+    void set_subpixel(int x, int y, const paint &color) { write_span(sp_at(x, y), 1, color); }
+    void mean_subpixel(int x0, int y0, int x1, int y1)
+    {
+        thread_local std::vector<uint16_t> scratch;
+        scratch.resize(simd::box_downsample_scratch<SN>(x1 - x0));
+        simd::box_downsample<SN>(sp_at(x0 * SN, y0 * SN), sp_stride(), m_canvas.raw_pixel(x0, y0),
+                                 m_canvas.stride(), x1 - x0, y1 - y0, scratch.data());
+    }
+
+    void sp_fill_span(int x0, int x1, int y, const paint &color)
+    {
+        if (x0 < x1)
+            write_span(sp_at(x0, y), x1 - x0, color);
+    }
+
+    void sp_fill_rect(int x0, int y0, int x1, int y1, const paint &color)
+    {
+        if (color.opaque())
+            return simd::fill_rect(sp_at(x0, y0), sp_stride(), x1 - x0, y1 - y0, color.bgrx);
+        for (int y = y0; y < y1; ++y)
+        {
+            sp_fill_span(x0, x1, y, color);
+        }
+    }
+
+    region tile_region(int tx, int ty) const
+    {
+        return {tx * TILE, ty * TILE, std::min(width(), (tx + 1) * TILE), std::min(height(), (ty + 1) * TILE)};
+    }
+
+    // write the clear color of a cleared tile into the backing store before drawing over it
+    void materialize(int tx, int ty, tile_state &t)
+    {
+        auto [x0, y0, x1, y1] = tile_region(tx, ty);
+        if (m_aa == AntiAlias::coverage)
+            m_canvas.fill_rect(x0, y0, x1, y1, t.clear.r, t.clear.g, t.clear.b);
+        else
+            sp_fill_rect(x0 * SN, y0 * SN, x1 * SN, y1 * SN, t.clear);
+        t.cleared = false;
+    }
+
+    // mark the pixels [x0, x1) x [y0, y1) as about to be drawn
+    void touch(int x0, int y0, int x1, int y1)
+    {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, width());
+        y1 = std::min(y1, height());
+        if (x0 >= x1 || y0 >= y1)
+            return;
+        for (int ty = y0 / TILE; ty <= (y1 - 1) / TILE; ++ty)
+        {
+            for (int tx = x0 / TILE; tx <= (x1 - 1) / TILE; ++tx)
+            {
+                tile_state &t = m_tiles[ty * m_tiles_x + tx];
+                if (t.cleared)
+                    materialize(tx, ty, t);
+                t.dirty = true;
+            }
+        }
+    }
+
+    // same as touch, in subpixel coordinates
+    void touch_sp(int x0, int y0, int x1, int y1)
+    {
+        x0 = std::clamp(x0, 0, sp_width());
+        y0 = std::clamp(y0, 0, sp_height());
+        x1 = std::clamp(x1, 0, sp_width());
+        y1 = std::clamp(y1, 0, sp_height());
+        touch(x0 / SN, y0 / SN, (x1 + SN - 1) / SN, (y1 + SN - 1) / SN);
+    }
+
+    // resolve the dirty tiles of one tile row, runs of drawn tiles are downsampled and cleared runs filled at once
+    void resolve_tile_row(int ty)
+    {
+        for (int tx = 0; tx < m_tiles_x; ++tx)
+        {
+            const tile_state &t = m_tiles[ty * m_tiles_x + tx];
+            if (!t.dirty)
+                continue;
+            auto rc = tile_region(tx, ty);
+            if (t.cleared)
+            {
+                int run = tx + 1;
+                while (run < m_tiles_x && m_tiles[ty * m_tiles_x + run].dirty &&
+                       m_tiles[ty * m_tiles_x + run].cleared && m_tiles[ty * m_tiles_x + run].clear == t.clear)
+                {
+                    ++run;
+                }
+                m_canvas.fill_rect(rc.x0, rc.y0, tile_region(run - 1, ty).x1, rc.y1, t.clear.r, t.clear.g, t.clear.b);
+                tx = run - 1;
+                continue;
+            }
+            if (!has_subpixels())
+                continue;
+            int run = tx + 1;
+            while (run < m_tiles_x && m_tiles[ty * m_tiles_x + run].dirty && !m_tiles[ty * m_tiles_x + run].cleared)
+            {
+                ++run;
+            }
+            mean_subpixel(rc.x0, rc.y0, tile_region(run - 1, ty).x1, rc.y1);
+            tx = run - 1;
+        }
+    }
+
+    // resolve dirty tiles into the RawCanvas and collect them as damage, consecutive tiles in a row are merged
+    void flush_tiles()
+    {
+        ScopedTimer timer(Phase::resolve);
+        if (m_pool)
+            m_pool->parallel_for(0, m_tiles_y, [this](int ty) { resolve_tile_row(ty); });
+        else
+        {
+            for (int ty = 0; ty < m_tiles_y; ++ty)
+            {
+                resolve_tile_row(ty);
+            }
+        }
+        m_damage.clear();
+        for (int ty = 0; ty < m_tiles_y; ++ty)
+        {
+            for (int tx = 0; tx < m_tiles_x; ++tx)
+            {
+                tile_state &t = m_tiles[ty * m_tiles_x + tx];
+                if (!t.dirty)
+                    continue;
+                t.dirty = false;
+                auto rc = tile_region(tx, ty);
+                if (!m_damage.empty() && m_damage.back().y0 == rc.y0 && m_damage.back().x1 == rc.x0)
+                    m_damage.back().x1 = rc.x1;
+                else
+                    m_damage.push_back(rc);
+            }
+        }
+    }
+
+    // coverage of a pixel whose center lies at signed distance d inside an edge
+    static float edge_coverage(float d) { return std::clamp(d + 0.5f, 0.0f, 1.0f); }
+    static int to_alpha(float coverage) { return static_cast<int>(coverage * 255 + 0.5f); }
+
+    // write color into a pixel covered by the fraction alpha / 255
+    void blend_pixel(int x, int y, const paint &color, int alpha)
+    {
+        if (alpha <= 0)
+            return;
+        uint8_t *p = m_canvas.raw_pixel(x, y);
+        if (alpha >= 255)
+            return write_span(p, 1, color);
+        if (color.opaque())
+        {
+            int ia = 255 - alpha;
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] = static_cast<uint8_t>((p[k] * ia + color.bgrx[k] * alpha + 127) / 255);
+            }
+            return;
+        }
+        uint8_t scaled[4] = {};
+        for (int k = 0; k < 3; ++k)
+        {
+            scaled[k] = static_cast<uint8_t>(simd::div255(color.bgrx[k] * alpha));
+        }
+        simd::blend_span(p, 1, scaled, static_cast<uint8_t>(simd::div255(color.a * alpha)), color.mode);
+    }
+
+    void cov_fill_span(int x0, int x1, int y, const paint &color)
+    {
+        if (x0 < x1)
+            write_span(m_canvas.raw_pixel(x0, y), x1 - x0, color);
+    }
+
+    // pixel-space bounding box [x0, x1) x [y0, y1) clipped to clip, false if empty
+    static bool cov_bounds(float fx0, float fx1, float fy0, float fy1, const region &clip, int &x0, int &x1, int &y0,
+                           int &y1)
+    {
+        x0 = std::max(clip.x0, static_cast<int>(std::floor(fx0)));
+        x1 = std::min(clip.x1, static_cast<int>(std::ceil(fx1)));
+        y0 = std::max(clip.y0, static_cast<int>(std::floor(fy0)));
+        y1 = std::min(clip.y1, static_cast<int>(std::ceil(fy1)));
+        return x0 < x1 && y0 < y1;
+    }
+
+    /* annulus R1 <= d <= R2 (R1 <= 0 for a disk), area coverage approximated per pixel center
+     * out receives begin(x0, y0, x1, y1) with the bounds, then solid span(x0, x1, y) and partial pixel(x, y, alpha)
+     * every row is split into nested ranges of pixel centers: within Ro, within Ri, within Si and within Hu, only the
+     * fringes between them are evaluated per pixel, the solid band is one span and the hole is skipped
+     */
+    template <typename Out>
+    static void cov_annulus(vec2f center, float R1, float R2, const region &clip, Out &&out)
+    {
+        float cx = center[0];
+        float cy = center[1];
+        float Ro = R2 + 0.5f; // beyond Ro nothing is covered
+        float Ri = R2 - 0.5f; // within Ri (and outside Si) fully covered
+        float Si = R1 > 0 ? R1 + 0.5f : 0; // within Si the inner edge cuts the coverage
+        float Hu = R1 - 0.5f; // within Hu the hole is fully uncovered
+        int x0, x1, y0, y1;
+        if (!cov_bounds(cx - Ro, cx + Ro, cy - Ro, cy + Ro, clip, x0, x1, y0, y1))
+            return;
+        out.begin(x0, y0, x1, y1);
+        auto fringe = [&](int a, int b, int y, float dy2)
+        {
+            for (int x = a; x < b; ++x)
+            {
+                float dx = x + 0.5f - cx;
+                float d = std::sqrt(dx * dx + dy2);
+                float cov = edge_coverage(R2 - d);
+                if (R1 > 0)
+                    cov -= edge_coverage(R1 - d);
+                int alpha = to_alpha(cov);
+                if (alpha > 0)
+                    out.pixel(x, y, alpha);
+            }
+        };
+        for (int y = y0; y < y1; ++y)
+        {
+            float dy = y + 0.5f - cy;
+            float dy2 = dy * dy;
+            if (dy2 >= Ro * Ro)
+                continue;
+            // pixels whose centers lie within r of the center horizontally, kept inside [lo, hi)
+            auto within = [&](float r, int lo, int hi, int &a, int &b)
+            {
+                if (r <= 0 || dy2 >= r * r)
+                {
+                    a = b = std::clamp(static_cast<int>(std::floor(cx)), lo, hi);
+                    return;
+                }
+                float h = std::sqrt(r * r - dy2);
+                a = std::clamp(static_cast<int>(std::ceil(cx - h - 0.5f)), lo, hi);
+                b = std::clamp(static_cast<int>(std::floor(cx + h - 0.5f)) + 1, a, hi);
+            };
+            int ox0, ox1, ix0, ix1, sx0, sx1, hx0, hx1;
+            within(Ro, x0, x1, ox0, ox1);
+            // a band thinner than a pixel has no solid part
+            within(Si < Ri ? Ri : Hu, ox0, ox1, ix0, ix1);
+            within(Si < Ri ? Si : Hu, ix0, ix1, sx0, sx1);
+            within(Hu, sx0, sx1, hx0, hx1);
+            if (ix0 < sx0)
+                out.span(ix0, sx0, y);
+            if (sx1 < ix1)
+                out.span(sx1, ix1, y);
+            fringe(ox0, ix0, y, dy2);
+            fringe(sx0, hx0, y, dy2);
+            fringe(hx1, sx1, y, dy2);
+            fringe(ix1, ox1, y, dy2);
+        }
+    }
+
+    // writes the output of a shape generator to the canvas, in pixels or subpixels
+    struct cov_writer
     {
-        uint8_t *p = sp_at(x, y);
-        p[0] = color.r;
-        p[1] = color.g;
-        p[2] = color.b;
+        BasicCanvas &canvas;
+        const paint &color;
+        void begin(int x0, int y0, int x1, int y1) { canvas.touch(x0, y0, x1, y1); }
+        void span(int x0, int x1, int y) { canvas.cov_fill_span(x0, x1, y, color); }
+        void pixel(int x, int y, int alpha) { canvas.blend_pixel(x, y, color, alpha); }
+    };
+    struct sp_writer
+    {
+        BasicCanvas &canvas;
+        const paint &color;
+        void begin(int x0, int y0, int x1, int y1) { canvas.touch_sp(x0, y0, x1, y1); }
+        void span(int x0, int x1, int y) { canvas.sp_fill_span(x0, x1, y, color); }
+    };
+
+    void cov_fill_annulus(vec2f center, float R1, float R2, const paint &color, const region &clip)
+    {
+        cov_annulus(center, R1, R2, clip, cov_writer{*this, color});
     }
-    void mean_subpixel()
+
+    /* box with half extents hw along (c, s) and hh across it, coverage as the product of the coverages along both axes
+     * per row the pixel centers within the box grown and shrunk by half a pixel are solved from the two slabs, the
+     * pixels in between are evaluated and the inner range is one span
+     */
+    void cov_fill_box(vec2f center, float c, float s, float hw, float hh, const paint &color, const region &clip)
     {
-        for (int y = 0; y < height(); ++y)
+        float ex = hw * std::abs(c) + hh * std::abs(s) + 0.5f;
+        float ey = hw * std::abs(s) + hh * std::abs(c) + 0.5f;
+        int x0, x1, y0, y1;
+        if (!cov_bounds(center[0] - ex, center[0] + ex, center[1] - ey, center[1] + ey, clip, x0, x1, y0, y1))
+            return;
+        touch(x0, y0, x1, y1);
+        for (int y = y0; y < y1; ++y)
         {
-            for (int x = 0; x < width(); ++x)
+            float dy = y + 0.5f - center[1];
+            // pixels whose centers satisfy |u| <= U and |v| <= V, kept inside [lo, hi)
+            auto within = [&](float U, float V, int lo, int hi, int &a, int &b)
             {
-                unsigned r = 0, g = 0, b = 0;
-                for (int sy = 0; sy < SN; ++sy)
+                double l = -1e9, r = 1e9;
+                auto slab = [&](double k, double offset, double half)
                 {
-                    int gy = y * SN + sy;
-                    for (int sx = 0; sx < SN; ++sx)
+                    // |k dx + offset| <= half
+                    if (std::abs(k) < 1e-9)
                     {
-                        int gx = x * SN + sx;
-                        uint8_t *p = sp_at(gx, gy);
-                        r += p[0];
-                        g += p[1];
-                        b += p[2];
+                        if (std::abs(offset) > half)
+                            l = r = 0;
+                        return;
                     }
+                    double p = (-half - offset) / k, q = (half - offset) / k;
+                    l = std::max(l, std::min(p, q));
+                    r = std::min(r, std::max(p, q));
+                };
+                if (U > 0 && V > 0)
+                {
+                    slab(c, double(dy) * s, U);  // u along width
+                    slab(-s, double(dy) * c, V); // v along height
                 }
-                r = (r + SN * SN / 2) / (SN * SN);
-                g = (g + SN * SN / 2) / (SN * SN);
-                b = (b + SN * SN / 2) / (SN * SN);
-                m_canvas.set_pixel(x, y, static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b));
-            }
+                else
+                    l = r = 0;
+                if (l >= r)
+                {
+                    a = b = std::clamp(static_cast<int>(std::floor(center[0])), lo, hi);
+                    return;
+                }
+                a = static_cast<int>(std::clamp(std::ceil(center[0] + l - 0.5), double(lo), double(hi)));
+                b = static_cast<int>(std::clamp(std::floor(center[0] + r - 0.5) + 1, double(a), double(hi)));
+            };
+            int ox0, ox1, ix0, ix1;
+            within(hw + 0.5f, hh + 0.5f, x0, x1, ox0, ox1);
+            within(hw - 0.5f, hh - 0.5f, ox0, ox1, ix0, ix1);
+            auto fringe = [&](int a, int b)
+            {
+                for (int x = a; x < b; ++x)
+                {
+                    float dx = x + 0.5f - center[0];
+                    float u = dx * c + dy * s;
+                    float v = -dx * s + dy * c;
+                    float cov = edge_coverage(hw - std::abs(u)) * edge_coverage(hh - std::abs(v));
+                    blend_pixel(x, y, color, to_alpha(cov));
+                }
+            };
+            fringe(ox0, ix0);
+            cov_fill_span(ix0, ix1, y, color);
+            fringe(ix1, ox1);
         }
     }
 
-    void sp_fill_rect(int x0, int y0, int x1, int y1, rgb color)
+    // rect of any angle
+    void cov_fill_rect(const geo2d::rect &r, const paint &color, const region &clip)
+    {
+        cov_fill_box(r.center, std::cos(r.angle), std::sin(r.angle), r.width / 2, r.height / 2, color, clip);
+    }
+
+    // a line of width w with square caps, the direction is taken from the line instead of an angle
+    void cov_fill_thick_line(const geo2d::line &l, float line_width, const paint &color, const region &clip)
     {
+        vec2f d = l.stop - l.start;
+        float len = d.norm();
+        float c = len > 0 ? d[0] / len : 1;
+        float s = len > 0 ? d[1] / len : 0;
+        cov_fill_box((l.start + l.stop) / 2, c, s, (len + line_width) / 2, line_width / 2, color, clip);
+    }
+
+    /* scanline disk or annulus R1 <= d <= R2, the span ends of every row are solved once
+     * everything is in subpixel units, out receives begin(x0, y0, x1, y1) and span(x0, x1, y) like cov_annulus
+     */
+    template <typename Out>
+    static void sp_annulus(float cx, float cy, float R1, float R2, const region &clip, Out &&out)
+    {
+        float r2 = R2 * R2;
+        float h2 = R1 > 0 ? R1 * R1 : 0;
+        int x0 = std::max<int>(std::round(cx - R2), clip.x0);
+        int x1 = std::min<int>(std::round(cx + R2), clip.x1);
+        int y0 = std::max<int>(std::round(cy - R2), clip.y0);
+        int y1 = std::min<int>(std::round(cy + R2), clip.y1);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+        out.begin(x0, y0, x1, y1);
         for (int y = y0; y < y1; ++y)
         {
-            for (int x = x0; x < x1; ++x)
+            float dy = y + 0.5f - cy;
+            float dy2 = dy * dy;
+            if (dy2 > r2)
+                continue;
+            // subpixel centers x + 0.5 within [cx - half, cx + half]
+            float half = std::sqrt(r2 - dy2);
+            int sx0 = std::max(x0, static_cast<int>(std::ceil(cx - half - 0.5f)));
+            int sx1 = std::min(x1, static_cast<int>(std::floor(cx + half - 0.5f)) + 1);
+            if (dy2 >= h2)
             {
-                set_subpixel(x, y, color);
+                if (sx0 < sx1)
+                    out.span(sx0, sx1, y);
+                continue;
             }
+            // the hole leaves out centers strictly within (cx - hole, cx + hole)
+            float hole = std::sqrt(h2 - dy2);
+            int hx0 = static_cast<int>(std::floor(cx - hole - 0.5f)) + 1;
+            int hx1 = static_cast<int>(std::ceil(cx + hole - 0.5f));
+            if (sx0 < std::min(sx1, hx0))
+                out.span(sx0, std::min(sx1, hx0), y);
+            if (std::max(sx0, hx1) < sx1)
+                out.span(std::max(sx0, hx1), sx1, y);
         }
     }
 
-  public:
-    Canvas(int width, int height) : m_canvas(width, height) { m_subpixels = new uint8_t[3 * width * height * SN * SN]; }
-    ~Canvas() { delete[] m_subpixels; }
+    void sp_fill_annulus(vec2f center, float R1, float R2, const paint &color, const region &clip)
+    {
+        region sub = {clip.x0 * SN, clip.y0 * SN, clip.x1 * SN, clip.y1 * SN};
+        sp_annulus(center[0] * SN, center[1] * SN, R1 * SN, R2 * SN, sub, sp_writer{*this, color});
+    }
 
-    RawCanvas &get_raw_canvas() { return m_canvas; }
-    int width() const { return m_canvas.width(); }
-    int height() const { return m_canvas.height(); }
-    void beginpaint() { m_canvas.beginpaint(); }
-    void endpaint()
+    /* horizontal extent of an ellipse with semi-axes a, b rotated by angle, per row
+     * the span center is linear and the squared half width quadratic in dy, each row is evaluated on its own
+     * so a clipped fill does not depend on the rows above the clip
+     */
+    struct ellipse_rows
+    {
+        double dmid;     // span center relative to the ellipse center, per unit of dy
+        double h0, k;    // squared half width h0 + k dy^2
+
+        ellipse_rows(double a, double b, double angle)
+        {
+            double c = std::cos(angle), s = std::sin(angle);
+            double ia2 = 1 / (a * a), ib2 = 1 / (b * b);
+            double A = c * c * ia2 + s * s * ib2;
+            double B = 2 * c * s * (ia2 - ib2);
+            k = -ia2 * ib2 / (A * A); // (B^2 - 4AC) / 4A^2
+            dmid = -B / (2 * A);
+            h0 = 1 / A;
+        }
+        // for the row whose center is dy below the ellipse center
+        double mid(double dy) const { return dmid * dy; }
+        double h2(double dy) const { return h0 + k * dy * dy; }
+    };
+
+    // half extents of the bounding box of a rotated ellipse
+    static void ellipse_extent(float a, float b, float angle, float &ex, float &ey)
     {
-        mean_subpixel();
-        m_canvas.endpaint();
+        float c = std::cos(angle), s = std::sin(angle);
+        ex = std::sqrt(a * a * c * c + b * b * s * s);
+        ey = std::sqrt(a * a * s * s + b * b * c * c);
     }
-    void fill(rgb color) { sp_fill_rect(0, 0, sp_width(), sp_height(), color); }
-    void save_bmp(const char *filename)
+
+    // approximate signed distance to an ellipse boundary, positive inside, exact for circles
+    static float ellipse_distance(float u, float v, float a, float b)
     {
-        mean_subpixel();
-        m_canvas.save_bmp(filename);
+        float ia2 = 1 / (a * a), ib2 = 1 / (b * b);
+        float q = std::sqrt(u * u * ia2 + v * v * ib2);
+        float g = std::sqrt(u * u * ia2 * ia2 + v * v * ib2 * ib2);
+        return g > 0 ? (1 - q) * q / g : std::min(a, b);
     }
 
-    void fill(const geo2d::circle &c, rgb color)
+    // outer and inner semi-axes of an ellipse filled (line_width <= 0) or stroked, false if there is no hole
+    static bool ellipse_band(const geo2d::ellipse &e, float line_width, float &ao, float &bo, float &ai, float &bi)
     {
-        int x0 = std::round((c.center[0] - c.radius) * SN);
-        int x1 = std::round((c.center[0] + c.radius) * SN);
-        int y0 = std::round((c.center[1] - c.radius) * SN);
-        int y1 = std::round((c.center[1] + c.radius) * SN);
+        float half = std::max(line_width, 0.0f) / 2;
+        ao = e.a + half;
+        bo = e.b + half;
+        ai = e.a - half;
+        bi = e.b - half;
+        return line_width > 0 && ai > 0 && bi > 0;
+    }
+
+    // filled ellipse or the band between two ellipses, coverage per pixel from the approximate edge distance
+    void cov_fill_ellipse(const geo2d::ellipse &e, float line_width, const paint &color, const region &clip)
+    {
+        static constexpr double margin = 1; // candidate pixels lie within margin of the outer ellipse
+        float ao, bo, ai, bi;
+        bool hole = ellipse_band(e, line_width, ao, bo, ai, bi);
+        if (ao <= 0 || bo <= 0)
+            return;
+        float ex, ey;
+        ellipse_extent(ao, bo, e.angle, ex, ey);
+        float cx = e.center[0], cy = e.center[1];
+        int x0, x1, y0, y1;
+        if (!cov_bounds(cx - ex - margin, cx + ex + margin, cy - ey - margin, cy + ey + margin, clip, x0, x1, y0, y1))
+            return;
+        touch(x0, y0, x1, y1);
+        float c = std::cos(e.angle), s = std::sin(e.angle);
+        const ellipse_rows shape(ao, bo, e.angle);
+        // dy of the rightmost point, the leftmost one is mirrored
+        double right_dy = (double(ao) * ao - double(bo) * bo) * c * s / ex;
+        auto half_at = [&](double dy) { return std::sqrt(std::max(0.0, shape.h2(dy))); };
+        auto alpha_at = [&](int x, int y)
+        {
+            float dx = x + 0.5f - cx, dy = y + 0.5f - cy;
+            float u = dx * c + dy * s;
+            float v = -dx * s + dy * c;
+            float cov = edge_coverage(ellipse_distance(u, v, ao, bo));
+            if (hole)
+                cov -= edge_coverage(ellipse_distance(u, v, ai, bi));
+            return to_alpha(cov);
+        };
         for (int y = y0; y < y1; ++y)
         {
-            if (unsigned(y) >= sp_height())
+            // x range of the outer ellipse over rows [dy - margin, dy + margin], grown by margin
+            double dy = y + 0.5 - cy;
+            double lo = std::max(dy - margin, double(-ey));
+            double hi = std::min(dy + margin, double(ey));
+            if (lo > hi)
                 continue;
-            for (int x = x0; x < x1; ++x)
+            double tr = std::clamp(right_dy, lo, hi);
+            double tl = std::clamp(-right_dy, lo, hi);
+            double right = shape.dmid * tr + half_at(tr) + margin;
+            double left = shape.dmid * tl - half_at(tl) - margin;
+            int sx0 = std::max(x0, static_cast<int>(std::ceil(cx + left - 0.5)));
+            int sx1 = std::min(x1, static_cast<int>(std::floor(cx + right - 0.5)) + 1);
+            // walk in from both ends, stopping at the solid interior of a disk or the hole of a band
+            int l = sx0;
+            bool seen = false;
+            for (; l < sx1; ++l)
             {
-                if (unsigned(x) >= sp_width())
-                    continue;
-                float fx = (x + 0.5) / SN;
-                float fy = (y + 0.5) / SN;
-                if ((c.center - vec2f(fx, fy)).norm() <= c.radius)
-                    set_subpixel(x, y, color);
+                int alpha = alpha_at(l, y);
+                if (hole ? (alpha <= 0 && seen) : alpha >= 255)
+                    break;
+                seen = seen || alpha > 0;
+                blend_pixel(l, y, color, alpha);
+            }
+            int r = sx1;
+            seen = false;
+            for (; r > l; --r)
+            {
+                int alpha = alpha_at(r - 1, y);
+                if (hole ? (alpha <= 0 && seen) : alpha >= 255)
+                    break;
+                seen = seen || alpha > 0;
+                blend_pixel(r - 1, y, color, alpha);
             }
+            if (!hole)
+                cov_fill_span(l, r, y, color);
         }
     }
 
-    void draw(const geo2d::circle &c, float line_width, rgb color)
+    // scanline filled ellipse or the band between two ellipses, on subpixel centers like sp_fill_annulus
+    void sp_fill_ellipse(const geo2d::ellipse &e, float line_width, const paint &color, const region &clip)
     {
-        float R1 = c.radius - line_width / 2;
-        float R2 = c.radius + line_width / 2;
-        int x0 = std::round((c.center[0] - R2) * SN);
-        int x1 = std::round((c.center[0] + R2) * SN);
-        int y0 = std::round((c.center[1] - R2) * SN);
-        int y1 = std::round((c.center[1] + R2) * SN);
+        float ao, bo, ai, bi;
+        bool hole = ellipse_band(e, line_width, ao, bo, ai, bi);
+        if (ao <= 0 || bo <= 0)
+            return;
+        float ex, ey;
+        ellipse_extent(ao * SN, bo * SN, e.angle, ex, ey);
+        float cx = e.center[0] * SN;
+        float cy = e.center[1] * SN;
+        int first = static_cast<int>(std::ceil(cy - ey - 0.5f));
+        int x0 = std::max(clip.x0 * SN, static_cast<int>(std::floor(cx - ex)));
+        int x1 = std::min(clip.x1 * SN, static_cast<int>(std::ceil(cx + ex)) + 1);
+        int y0 = std::max(clip.y0 * SN, first);
+        int y1 = std::min(clip.y1 * SN, static_cast<int>(std::floor(cy + ey - 0.5f)) + 1);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+        touch_sp(x0, y0, x1, y1);
+        const ellipse_rows outer(ao * SN, bo * SN, e.angle);
+        const ellipse_rows inner(hole ? ai * SN : 1, hole ? bi * SN : 1, e.angle);
         for (int y = y0; y < y1; ++y)
         {
-            if (unsigned(y) >= sp_height())
+            double dy = y + 0.5 - cy;
+            double h2 = outer.h2(dy);
+            if (h2 < 0)
                 continue;
-            for (int x = x0; x < x1; ++x)
+            double half = std::sqrt(h2);
+            int sx0 = std::max(x0, static_cast<int>(std::ceil(cx + outer.mid(dy) - half - 0.5)));
+            int sx1 = std::min(x1, static_cast<int>(std::floor(cx + outer.mid(dy) + half - 0.5)) + 1);
+            double inner_h2 = inner.h2(dy);
+            if (!hole || inner_h2 <= 0)
             {
-                if (unsigned(x) >= sp_width())
-                    continue;
-                float fx = (x + 0.5) / SN;
-                float fy = (y + 0.5) / SN;
-                float d = (c.center - vec2f(fx, fy)).norm();
-                if (d >= R1 && d <= R2)
-                    set_subpixel(x, y, color);
+                sp_fill_span(sx0, sx1, y, color);
+                continue;
             }
+            // the hole leaves out centers strictly inside the inner ellipse
+            double hw = std::sqrt(inner_h2);
+            int hx0 = static_cast<int>(std::floor(cx + inner.mid(dy) - hw - 0.5)) + 1;
+            int hx1 = static_cast<int>(std::ceil(cx + inner.mid(dy) + hw - 0.5));
+            sp_fill_span(sx0, std::min(sx1, hx0), y, color);
+            sp_fill_span(std::max(sx0, hx1), sx1, y, color);
         }
     }
 
-    void fill(const geo2d::triangle &t, rgb color)
+    /* half-space triangle rasterizer with a top-left fill rule
+     * vertices are snapped to 1/FP subpixel, edge functions are exact 64 bit integers stepped per row,
+     * the covered run of each row is located by simd::edge_span 4 or 8 samples at a time
+     */
+    void sp_fill_triangle(const geo2d::triangle &t, const paint &color, const region &clip)
     {
-        int xmin = std::max(0, static_cast<int>(std::round(t.xmin() * SN)));
-        int xmax = std::min(sp_width(), static_cast<int>(std::round(t.xmax() * SN)));
+        static constexpr int FP = 16;
+        auto snap = [](float v) { return static_cast<int64_t>(std::llround(static_cast<double>(v) * SN * FP)); };
+        int64_t x[3] = {snap(t.a[0]), snap(t.b[0]), snap(t.c[0])};
+        int64_t y[3] = {snap(t.a[1]), snap(t.b[1]), snap(t.c[1])};
+        int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0)
+            return;
+        if (area < 0)
+        {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+        }
+        auto floor_div = [](int64_t v) { return static_cast<int>(v >= 0 ? v / FP : -((-v + FP - 1) / FP)); };
+        int x0 = std::max(clip.x0 * SN, floor_div(std::min({x[0], x[1], x[2]})));
+        int x1 = std::min(clip.x1 * SN, floor_div(std::max({x[0], x[1], x[2]})) + 1);
+        int y0 = std::max(clip.y0 * SN, floor_div(std::min({y[0], y[1], y[2]})));
+        int y1 = std::min(clip.y1 * SN, floor_div(std::max({y[0], y[1], y[2]})) + 1);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+        touch_sp(x0, y0, x1, y1);
+        // E_k(p) = A_k (p.x - x_k) + B_k (p.y - y_k) is positive inside, evaluated at subpixel centers
+        int64_t e[3], dx[3], dy[3];
+        int64_t px = int64_t(x0) * FP + FP / 2;
+        int64_t py = int64_t(y0) * FP + FP / 2;
+        for (int k = 0; k < 3; ++k)
+        {
+            int j = (k + 1) % 3;
+            int64_t A = y[k] - y[j];
+            int64_t B = x[j] - x[k];
+            bool top_left = A > 0 || (A == 0 && B > 0);
+            e[k] = A * (px - x[k]) + B * (py - y[k]) - (top_left ? 0 : 1);
+            dx[k] = A * FP;
+            dy[k] = B * FP;
+        }
+        for (int sy = y0; sy < y1; ++sy)
+        {
+            int begin, end;
+            simd::edge_span(e, dx, x1 - x0, begin, end);
+            sp_fill_span(x0 + begin, x0 + end, sy, color);
+            for (int k = 0; k < 3; ++k)
+            {
+                e[k] += dy[k];
+            }
+        }
     }
 
-    void fill(const geo2d::rect &r, rgb color)
+    /* convex polygon coverage from the signed distance to the nearest edge, out receives begin and pixel
+     * edges whose bit in soft is clear are shared with neighbouring pieces and only test the pixel center
+     */
+    template <typename Out>
+    static void cov_convex(const vec2f *pts, int n, uint32_t soft, const region &clip, Out &&out)
     {
-        static constexpr float pi = std::numbers::pi_v<float>;
-        if (r.angle == 0 || r.angle == 2 * pi || r.angle == -2 * pi)
+        float area = 0;
+        float xmin = pts[0][0], xmax = pts[0][0], ymin = pts[0][1], ymax = pts[0][1];
+        for (int k = 0; k < n; ++k)
         {
-            auto [x0, x1] = r.xminmax();
-            auto [y0, y1] = r.yminmax();
-            int ix0 = std::max(0, static_cast<int>(std::round(x0 * SN)));
-            int ix1 = std::min(sp_width(), static_cast<int>(std::round(x1 * SN)));
-            int iy0 = std::max(0, static_cast<int>(std::round(y0 * SN)));
-            int iy1 = std::min(sp_height(), static_cast<int>(std::round(y1 * SN)));
-            sp_fill_rect(ix0, iy0, ix1, iy1, color);
+            const vec2f &p = pts[k];
+            const vec2f &q = pts[(k + 1) % n];
+            area += p[0] * q[1] - q[0] * p[1];
+            xmin = std::min(xmin, p[0]);
+            xmax = std::max(xmax, p[0]);
+            ymin = std::min(ymin, p[1]);
+            ymax = std::max(ymax, p[1]);
+        }
+        if (area == 0)
             return;
+        int x0, x1, y0, y1;
+        if (!cov_bounds(xmin - 0.5f, xmax + 0.5f, ymin - 0.5f, ymax + 0.5f, clip, x0, x1, y0, y1))
+            return;
+        out.begin(x0, y0, x1, y1);
+        // unit inward normals, d_k = a_k x + b_k y + c_k, the hard edges come after the m soft ones
+        thread_local std::vector<float> a, b, c;
+        a.resize(n);
+        b.resize(n);
+        c.resize(n);
+        int m = 0, hard = n;
+        for (int k = 0; k < n; ++k)
+        {
+            const vec2f &p = pts[k];
+            const vec2f &q = pts[(k + 1) % n];
+            float len = (q - p).norm();
+            if (len == 0)
+                continue;
+            float sign = area > 0 ? 1.0f : -1.0f;
+            int i = k >= 32 || (soft >> k & 1) ? m++ : --hard;
+            a[i] = sign * (p[1] - q[1]) / len;
+            b[i] = sign * (q[0] - p[0]) / len;
+            c[i] = -(a[i] * p[0] + b[i] * p[1]);
         }
-        float c = std::cos(r.angle);
-        float s = std::sin(r.angle);
-        float hw = r.width / 2;
-        float hh = r.height / 2;
-        float x0 = r.center[0] - hw * c - hh * s;
-        float x1 = r.center[0] + hw * c - hh * s;
-        float x2 = r.center[0] + hw * c + hh * s;
-        float x3 = r.center[0] - hw * c + hh * s;
-        float y0 = r.center[1] - hw * s + hh * c;
-        float y1 = r.center[1] + hw * s + hh * c;
-        float y2 = r.center[1] + hw * s - hh * c;
-        float y3 = r.center[1] - hw * s - hh * c;
-        if (std::abs(r.angle) < pi / 4)
-        {
-            float Dy = r.height * SN / c;                        // 竖直方向的像素数
-            int xmin = std::round((r.angle > 0 ? x0 : x3) * SN); // 左边的顶点
-            int xmax = std::round((r.angle > 0 ? x2 : x1) * SN); // 右边的顶点
-            int xc1 = std::round((r.angle > 0 ? x3 : x0) * SN);  // 中间的顶点
-            int xc2 = std::round((r.angle > 0 ? x1 : x2) * SN);
-            float t = (xmin - x3 * SN) / (x2 * SN - x3 * SN);
-            float fy = lerp(y3, y2, t) * SN;
-            int ymin = std::round(fy);
-            float e = ymin + 0.5 - fy;
-            float slop = std::abs((y2 - y3) / (x2 - x3));
-            float incy = y2 > y3 ? 1 : -1;
-            for (int x = xmin; x < xmax; ++x)
-            {
-                if (unsigned(x) >= sp_width())
-                    continue;
-                for (int y = ymin; y < ymin + Dy - e; ++y)
+        if (m == 0)
+            return;
+        for (int y = y0; y < y1; ++y)
+        {
+            float fy = y + 0.5f;
+            /* pixels whose centers are at least soft_min inside every soft edge and hard_min inside every hard one,
+             * kept inside [lo, hi), every edge bounds the row from one side
+             */
+            auto within = [&](float soft_min, float hard_min, int lo, int hi, int &l, int &r)
+            {
+                double left = -1e9, right = 1e9;
+                auto edge = [&](int k, float t)
                 {
-                    if (unsigned(y) >= sp_height())
-                        continue;
-                    if (x >= xc1 && x < xc2)
-                        set_subpixel(x, y, color);
-                    else
+                    double offset = double(b[k]) * fy + c[k];
+                    if (std::abs(a[k]) < 1e-9f)
                     {
-                        float t1 = (y - y3 * SN) / (y0 * SN - y3 * SN);
-                        float t2 = (y - y2 * SN) / (y1 * SN - y2 * SN);
-                        float tx1 = lerp(x3, x0, t1) * SN;
-                        float tx2 = lerp(x2, x1, t2) * SN;
-                        if ((x - tx1) * (x - tx2) <= 0)
-                            set_subpixel(x, y, color);
+                        if (offset < t)
+                            left = right = 0;
+                        return;
                     }
+                    double x = (t - offset) / a[k];
+                    if (a[k] > 0)
+                        left = std::max(left, x);
+                    else
+                        right = std::min(right, x);
+                };
+                for (int k = 0; k < m; ++k)
+                {
+                    edge(k, soft_min);
+                }
+                for (int k = hard; k < n; ++k)
+                {
+                    edge(k, hard_min);
+                }
+                if (left > right)
+                {
+                    l = r = lo;
+                    return;
                 }
-                e += slop;
-                if (e >= 1)
+                l = static_cast<int>(std::clamp(std::ceil(left - 0.5), double(lo), double(hi)));
+                r = static_cast<int>(std::clamp(std::floor(right - 0.5) + 1, double(l), double(hi)));
+            };
+            // partially covered pixels lie within half a pixel of a soft edge, or next to a hard one
+            int ox0, ox1, ix0, ix1;
+            within(-0.501f, -1e-3f, x0, x1, ox0, ox1);
+            within(0.5f, 1e-3f, ox0, ox1, ix0, ix1);
+            if (ix0 == ix1)
+                ix0 = ix1 = ox1;
+            auto fringe = [&](int from, int to)
+            {
+                for (int x = from; x < to; ++x)
                 {
-                    e -= 1;
-                    ymin += incy;
+                    float fx = x + 0.5f;
+                    float d = a[0] * fx + b[0] * fy + c[0];
+                    for (int k = 1; k < m; ++k)
+                    {
+                        d = std::min(d, a[k] * fx + b[k] * fy + c[k]);
+                    }
+                    for (int k = hard; k < n && d > -0.5f; ++k)
+                    {
+                        if (a[k] * fx + b[k] * fy + c[k] < 0)
+                            d = -0.5f;
+                    }
+                    int alpha = to_alpha(edge_coverage(d));
+                    if (alpha > 0)
+                        out.pixel(x, y, alpha);
                 }
+            };
+            fringe(ox0, ix0);
+            if (ix0 < ix1)
+                out.span(ix0, ix1, y);
+            fringe(ix1, ox1);
+        }
+    }
+
+    void cov_fill_convex(const vec2f *pts, int n, const paint &color, const region &clip)
+    {
+        cov_convex(pts, n, ~0u, clip, cov_writer{*this, color});
+    }
+
+    /* convex polygon scanline filler, covers the samples whose centers lie in [left, right) of each row
+     * every edge is stepped once over its rows in 16.16 fixed point, so the result does not depend on the clip
+     * points and clip are in pixels, out receives begin and span in subpixels
+     */
+    template <typename Out>
+    static void sp_convex(const vec2f *pts, int n, const region &clip, Out &&out)
+    {
+        static constexpr int64_t ONE = int64_t(1) << 16;
+        static constexpr int64_t HALF = ONE / 2;
+        auto fixed = [](double v) { return static_cast<int64_t>(std::llround(v * ONE)); };
+        auto first_row = [](double y) { return static_cast<int>(std::ceil(y * SN - 0.5)); }; // first center >= y
+        double area = 0;
+        float xmin = pts[0][0], xmax = pts[0][0], ymin = pts[0][1], ymax = pts[0][1];
+        for (int k = 0; k < n; ++k)
+        {
+            const vec2f &p = pts[k];
+            const vec2f &q = pts[(k + 1) % n];
+            area += double(p[0]) * q[1] - double(q[0]) * p[1];
+            xmin = std::min(xmin, p[0]);
+            xmax = std::max(xmax, p[0]);
+            ymin = std::min(ymin, p[1]);
+            ymax = std::max(ymax, p[1]);
+        }
+        int y0 = std::max(clip.y0 * SN, first_row(ymin));
+        int y1 = std::min(clip.y1 * SN, first_row(ymax));
+        int cx0 = std::max(clip.x0 * SN, static_cast<int>(std::floor(xmin * SN)));
+        int cx1 = std::min(clip.x1 * SN, static_cast<int>(std::ceil(xmax * SN)) + 1);
+        if (area == 0 || y0 >= y1 || cx0 >= cx1)
+            return;
+        thread_local std::vector<int64_t> left, right;
+        left.assign(y1 - y0, std::numeric_limits<int64_t>::min());
+        right.assign(y1 - y0, std::numeric_limits<int64_t>::max());
+        for (int k = 0; k < n; ++k)
+        {
+            const vec2f &p = pts[k];
+            const vec2f &q = pts[(k + 1) % n];
+            if (p[1] == q[1])
+                continue;
+            // with positive area (y down) edges going down bound the right side
+            bool is_right = (q[1] > p[1]) == (area > 0);
+            const vec2f &top = p[1] < q[1] ? p : q;
+            const vec2f &bottom = p[1] < q[1] ? q : p;
+            double dxdy = (double(bottom[0]) - top[0]) / (double(bottom[1]) - top[1]);
+            int r0 = first_row(top[1]);
+            int r1 = first_row(bottom[1]);
+            int64_t x = fixed((top[0] - (top[1] * SN - (r0 + 0.5)) / SN * dxdy) * SN);
+            int64_t step = fixed(dxdy);
+            int ra = std::max(r0, y0);
+            int rb = std::min(r1, y1);
+            x += (ra - r0) * step;
+            for (int r = ra; r < rb; ++r, x += step)
+            {
+                if (is_right)
+                    right[r - y0] = std::min(right[r - y0], x);
+                else
+                    left[r - y0] = std::max(left[r - y0], x);
             }
         }
+        out.begin(cx0, y0, cx1, y1);
+        for (int r = y0; r < y1; ++r)
+        {
+            int64_t l = left[r - y0];
+            int64_t rt = right[r - y0];
+            if (l == std::numeric_limits<int64_t>::min() || rt == std::numeric_limits<int64_t>::max())
+                continue;
+            // first sample with x + 0.5 >= l, first sample with x + 0.5 >= rt
+            int sx0 = static_cast<int>((l - HALF + ONE - 1) >> 16);
+            int sx1 = static_cast<int>((rt - HALF + ONE - 1) >> 16);
+            sx0 = std::max(sx0, cx0);
+            sx1 = std::min(sx1, cx1);
+            if (sx0 < sx1)
+                out.span(sx0, sx1, r);
+        }
     }
 
-    void draw(const geo2d::line &l, float line_width, rgb color)
+    void sp_fill_convex(const vec2f *pts, int n, const paint &color, const region &clip)
     {
-        float height = line_width;
-        float width = (l.stop - l.start).norm() + height;
-        vec2f center = (l.start + l.stop) / 2;
-        float angle = std::atan2(l.stop[1] - l.start[1], l.stop[0] - l.start[0]);
-        geo2d::rect r{height, width, center, angle};
-        fill(r, color);
+        sp_convex(pts, n, clip, sp_writer{*this, color});
     }
-};
+
+    static std::array<vec2f, 4> rect_corners(const geo2d::rect &r)
+    {
+        float c = std::cos(r.angle);
+        float s = std::sin(r.angle);
+        vec2f u = {r.width / 2 * c, r.width / 2 * s};   // along width
+        vec2f v = {-r.height / 2 * s, r.height / 2 * c}; // along height
+        return {r.center - u - v, r.center + u - v, r.center + u + v, r.center - u + v};
+    }
+
+    // a line of width w with square caps, as a quad
+    static std::array<vec2f, 4> line_corners(const geo2d::line &l, float line_width)
+    {
+        vec2f d = l.stop - l.start;
+        float len = d.norm();
+        vec2f u = len > 0 ? vec2f(d * (line_width / 2 / len)) : vec2f(line_width / 2, 0.0f);
+        vec2f v = {-u[1], u[0]};
+        return {l.start - u - v, l.stop + u - v, l.stop + u + v, l.start - u + v};
+    }
+
+    /* instanced stamps: a circle or ring rasterized once per radius and fractional offset, then blitted
+     * positions are quantized to 1/STAMP_STEPS pixel, masks live in subpixels (supersample) or pixels (coverage)
+     */
+    static constexpr int STAMP_STEPS = 16;
+    static constexpr size_t STAMP_BUDGET = size_t(1) << 22; // cached runs and alpha bytes before the cache is reset
+
+    struct stamp_run
+    {
+        int y, x0, x1;
+        int alpha; // offset of x1 - x0 partial alphas in stamp_mask::alpha, -1 for a solid span
+    };
+    struct stamp_mask
+    {
+        region box; // relative to the stamp origin, in mask units
+        std::vector<stamp_run> runs;
+        std::vector<uint8_t> alpha;
+    };
+    struct stamp_key
+    {
+        float R1, R2;
+        int fx, fy;
+        bool operator==(const stamp_key &) const = default;
+    };
+    struct stamp_key_hash
+    {
+        size_t operator()(const stamp_key &k) const
+        {
+            uint64_t h = std::bit_cast<uint32_t>(k.R1) * 0x9E3779B97F4A7C15ull;
+            h ^= (h >> 29) + std::bit_cast<uint32_t>(k.R2) * 0xBF58476D1CE4E5B9ull;
+            h ^= (h >> 31) + static_cast<uint64_t>(k.fx * STAMP_STEPS + k.fy) * 0x94D049BB133111EBull;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+    // unordered_map keeps values in place, recorded commands point into it until the next flush
+    std::unordered_map<stamp_key, stamp_mask, stamp_key_hash> m_stamps;
+    size_t m_stamp_size = 0;
+
+    // collects a shape generator's output as runs
+    struct stamp_recorder
+    {
+        stamp_mask &mask;
+        void begin(int x0, int y0, int x1, int y1) { mask.box = {x0, y0, x1, y1}; }
+        void span(int x0, int x1, int y) { mask.runs.push_back({y, x0, x1, -1}); }
+        void pixel(int x, int y, int alpha)
+        {
+            stamp_run *last = mask.runs.empty() ? nullptr : &mask.runs.back();
+            if (!last || last->alpha < 0 || last->y != y || last->x1 != x)
+                mask.runs.push_back({y, x, x, static_cast<int>(mask.alpha.size())});
+            mask.runs.back().x1 = x + 1;
+            mask.alpha.push_back(static_cast<uint8_t>(alpha));
+        }
+    };
+
+    // mask units per pixel
+    int stamp_unit() const { return m_aa == AntiAlias::supersample ? SN : 1; }
+
+    const stamp_mask &stamp_mask_for(float R1, float R2, int fx, int fy)
+    {
+        auto [it, inserted] = m_stamps.try_emplace(stamp_key{R1, R2, fx, fy});
+        stamp_mask &mask = it->second;
+        if (!inserted)
+            return mask;
+        static constexpr int huge = 1 << 24;
+        const region unbounded = {-huge, -huge, huge, huge};
+        if (m_aa == AntiAlias::supersample)
+        {
+            // fx, fy are steps within one subpixel
+            float step = float(SN) / STAMP_STEPS;
+            sp_annulus(fx * step, fy * step, R1 * SN, R2 * SN, unbounded, stamp_recorder{mask});
+        }
+        else
+        {
+            vec2f center = {float(fx) / STAMP_STEPS, float(fy) / STAMP_STEPS};
+            cov_annulus(center, R1, R2, unbounded, stamp_recorder{mask});
+        }
+        m_stamp_size += mask.runs.size() * sizeof(stamp_run) + mask.alpha.size();
+        return mask;
+    }
+
+    // stamps are recorded commands like the shapes, the mask is built on the submitting thread
+    struct stamp
+    {
+        const stamp_mask *mask;
+        int x, y;    // origin in mask units
+        region area; // covered pixels, for binning
+    };
+
+    void stamp_instances(float R1, float R2, vec2f center, std::span<const vec2f> offsets, const paint &color)
+    {
+        int unit = stamp_unit();
+        int per_unit = STAMP_STEPS / unit; // quantization steps per mask unit
+        auto floor_div = [](int64_t v, int d) { return static_cast<int>(v >= 0 ? v / d : -((-v + d - 1) / d)); };
+        for (const vec2f &offset : offsets)
+        {
+            int64_t qx = std::llround(double(center[0] + offset[0]) * STAMP_STEPS);
+            int64_t qy = std::llround(double(center[1] + offset[1]) * STAMP_STEPS);
+            int x = floor_div(qx, per_unit);
+            int y = floor_div(qy, per_unit);
+            const stamp_mask &mask = stamp_mask_for(R1, R2, static_cast<int>(qx - int64_t(x) * per_unit),
+                                                    static_cast<int>(qy - int64_t(y) * per_unit));
+            if (mask.runs.empty())
+                continue;
+            region area = {floor_div(int64_t(x) + mask.box.x0, unit), floor_div(int64_t(y) + mask.box.y0, unit),
+                           floor_div(int64_t(x) + mask.box.x1 + unit - 1, unit),
+                           floor_div(int64_t(y) + mask.box.y1 + unit - 1, unit)};
+            submit({stamp{&mask, x, y, area}, color});
+        }
+    }
+
+    void blit_stamp(const stamp &st, const paint &color, const region &clip)
+    {
+        int unit = stamp_unit();
+        region c = {clip.x0 * unit, clip.y0 * unit, clip.x1 * unit, clip.y1 * unit};
+        const stamp_mask &mask = *st.mask;
+        int x0 = std::max(c.x0, st.x + mask.box.x0), x1 = std::min(c.x1, st.x + mask.box.x1);
+        int y0 = std::max(c.y0, st.y + mask.box.y0), y1 = std::min(c.y1, st.y + mask.box.y1);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+        bool sp = m_aa == AntiAlias::supersample;
+        if (sp)
+            touch_sp(x0, y0, x1, y1);
+        else
+            touch(x0, y0, x1, y1);
+        // runs are sorted by row
+        auto run = std::lower_bound(mask.runs.begin(), mask.runs.end(), y0 - st.y,
+                                    [](const stamp_run &r, int y) { return r.y < y; });
+        for (; run != mask.runs.end() && run->y + st.y < y1; ++run)
+        {
+            int y = run->y + st.y;
+            int a = std::max(x0, run->x0 + st.x);
+            int b = std::min(x1, run->x1 + st.x);
+            if (a >= b)
+                continue;
+            if (run->alpha >= 0)
+            {
+                const uint8_t *alpha = mask.alpha.data() + run->alpha + (a - run->x0 - st.x);
+                for (int x = a; x < b; ++x)
+                {
+                    blend_pixel(x, y, color, *alpha++);
+                }
+            }
+            else if (sp)
+                sp_fill_span(a, b, y, color);
+            else
+                cov_fill_span(a, b, y, color);
+        }
+    }
+
+    /* polyline stroker: the stroke is split into convex pieces (segment quads, bevel or miter joins) and disks
+     * (round joins and caps), all pieces append their runs to one list, which is sorted and merged per row so
+     * every pixel is written once, in coverage mode overlapping partial pixels keep the largest coverage
+     */
+    struct stroke_run
+    {
+        int y, x0, x1;
+        int alpha; // 255 for a solid span, else a single pixel
+    };
+    struct stroke_collector
+    {
+        BasicCanvas &canvas;
+        std::vector<stroke_run> &runs;
+        void begin(int x0, int y0, int x1, int y1)
+        {
+            if (canvas.m_aa == AntiAlias::supersample)
+                canvas.touch_sp(x0, y0, x1, y1);
+            else
+                canvas.touch(x0, y0, x1, y1);
+        }
+        void span(int x0, int x1, int y) { runs.push_back({y, x0, x1, 255}); }
+        void pixel(int x, int y, int alpha) { runs.push_back({y, x, x + 1, alpha}); }
+    };
+
+    // the visible pieces of a stroke, every piece goes to convex(pts, n, soft edges) or disk(center)
+    template <typename Convex, typename Disk>
+    static void stroke_pieces(const geo2d::polyline &pl, const stroke_style &st, Convex &&convex, Disk &&disk)
+    {
+        thread_local std::vector<vec2f> pts;
+        pts.clear();
+        for (const vec2f &p : pl.points)
+        {
+            if (pts.empty() || p != pts.back())
+                pts.push_back(p);
+        }
+        if (pl.closed && pts.size() > 2 && pts.front() == pts.back())
+            pts.pop_back();
+        int n = static_cast<int>(pts.size());
+        float hw = st.width / 2;
+        if (n == 0 || hw <= 0)
+            return;
+        bool closed = pl.closed && n > 2;
+        if (n == 1)
+        {
+            if (st.cap == LineCap::round)
+                disk(pts[0]);
+            else if (st.cap == LineCap::square)
+            {
+                vec2f q[4] = {pts[0] + vec2f(-hw, -hw), pts[0] + vec2f(hw, -hw), pts[0] + vec2f(hw, hw),
+                              pts[0] + vec2f(-hw, hw)};
+                convex(q, 4, 0xFu);
+            }
+            return;
+        }
+        int segments = closed ? n : n - 1;
+        auto normal = [&](int i)
+        {
+            vec2f d = pts[(i + 1) % n] - pts[i];
+            d /= d.norm();
+            return vec2f(-d[1], d[0]);
+        };
+        /* a join whose miter is within the limit, or whose styles differ by less than 1/64 pixel, is made by
+         * cutting both segments at the bisector, the quads then share that edge and no join piece is needed
+         * miter[i] is the offset of the left corner at vertex i, cut[i] is false where a join piece is drawn
+         */
+        thread_local std::vector<vec2f> miter;
+        thread_local std::vector<uint8_t> cut;
+        miter.assign(n, vec2f(0.0f, 0.0f));
+        cut.assign(n, 0);
+        for (int i = closed ? 0 : 1; i < (closed ? n : n - 1); ++i)
+        {
+            int prev = (i + n - 1) % n, next = (i + 1) % n;
+            vec2f n0 = normal(prev), n1 = normal(i);
+            vec2f bis = n0 + n1;
+            float len2 = bis[0] * bis[0] + bis[1] * bis[1];
+            if (len2 == 0)
+                continue;
+            float ratio = 2 / std::sqrt(len2); // miter length over the width
+            bool miter_ok = st.join == LineJoin::miter && ratio <= st.miter_limit;
+            bool negligible = hw * (ratio - 1) < 1.0f / 64;
+            vec2f m = bis * (2 * hw / len2);
+            // the inner corner moves back along both segments, it has to stay within their first half
+            float back = std::abs(m[0] * n0[1] - m[1] * n0[0]);
+            float room = std::min((pts[i] - pts[prev]).norm(), (pts[next] - pts[i]).norm()) / 2;
+            if ((miter_ok || negligible) && back <= room)
+            {
+                miter[i] = m;
+                cut[i] = 1;
+            }
+        }
+        for (int i = 0; i < segments; ++i)
+        {
+            int j = (i + 1) % n;
+            vec2f a = pts[i], b = pts[j];
+            vec2f nv = normal(i);
+            vec2f o = nv * hw;
+            // open ends are soft edges unless a round cap covers them
+            bool first = !closed && i == 0, last = !closed && i == segments - 1;
+            if (st.cap == LineCap::square)
+            {
+                vec2f ext = vec2f(nv[1], -nv[0]) * hw; // along the segment
+                if (first)
+                    a -= ext;
+                if (last)
+                    b += ext;
+            }
+            bool cap_edge = st.cap != LineCap::round;
+            uint32_t soft = 0x5u | (last && cap_edge ? 0x2u : 0u) | (first && cap_edge ? 0x8u : 0u);
+            vec2f oa = cut[i] ? miter[i] : o, ob = cut[j] ? miter[j] : o;
+            vec2f q[4] = {a - oa, b - ob, b + ob, a + oa};
+            convex(q, 4, soft);
+        }
+        if (!closed && st.cap == LineCap::round)
+        {
+            disk(pts[0]);
+            disk(pts[n - 1]);
+        }
+        for (int i = closed ? 0 : 1; i < (closed ? n : n - 1); ++i)
+        {
+            if (cut[i])
+                continue;
+            vec2f v = pts[i];
+            vec2f n0 = normal((i + n - 1) % n), n1 = normal(i);
+            if (st.join == LineJoin::round)
+            {
+                disk(v);
+                continue;
+            }
+            // the outer side of the turn is opposite to the side it bends to
+            float cross = n0[0] * n1[1] - n0[1] * n1[0];
+            float side = cross > 0 ? -hw : hw;
+            vec2f e0 = v + n0 * side, e1 = v + n1 * side;
+            vec2f bis = n0 + n1;
+            float len = bis.norm();
+            if (st.join == LineJoin::miter && len > 0 && 2 / len <= st.miter_limit)
+            {
+                vec2f q[4] = {v, e0, v + bis * (side * 2 / (len * len)), e1};
+                convex(q, 4, 0x6u);
+            }
+            else
+            {
+                vec2f q[3] = {v, e0, e1};
+                convex(q, 3, 0x2u);
+            }
+        }
+    }
+
+    void stroke_polyline(const geo2d::polyline &pl, const stroke_style &st, const paint &color, const region &clip)
+    {
+        stroke_merged(
+            st.width / 2, color, clip,
+            [&](auto &&convex, auto &&disk) { stroke_pieces(pl, st, convex, disk); });
+    }
+
+    // rasterizes the pieces given by pieces(convex, disk) with half width hw and merges their runs
+    template <typename Pieces>
+    void stroke_merged(float hw, const paint &color, const region &clip, Pieces &&pieces)
+    {
+        thread_local std::vector<stroke_run> runs;
+        runs.clear();
+        stroke_collector out{*this, runs};
+        bool sp = m_aa == AntiAlias::supersample;
+        region sub = {clip.x0 * SN, clip.y0 * SN, clip.x1 * SN, clip.y1 * SN};
+        pieces(
+            [&](const vec2f *pts, int n, uint32_t soft)
+            {
+                if (sp)
+                    sp_convex(pts, n, clip, out);
+                else
+                    cov_convex(pts, n, soft, clip, out);
+            },
+            [&](vec2f c)
+            {
+                if (sp)
+                    sp_annulus(c[0] * SN, c[1] * SN, 0, hw * SN, sub, out);
+                else
+                    cov_annulus(c, 0, hw, clip, out);
+            });
+        if (runs.empty())
+            return;
+        // bucket by row, then sort each row by start with solid spans before pixels at the same start
+        thread_local std::vector<stroke_run> sorted;
+        thread_local std::vector<int> first;
+        auto [lo, hi] = std::minmax_element(runs.begin(), runs.end(),
+                                            [](const stroke_run &a, const stroke_run &b) { return a.y < b.y; });
+        int ymin = lo->y, rows = hi->y - ymin + 1;
+        first.assign(rows + 1, 0);
+        for (const stroke_run &r : runs)
+            ++first[r.y - ymin + 1];
+        for (int k = 0; k < rows; ++k)
+            first[k + 1] += first[k];
+        sorted.resize(runs.size());
+        for (const stroke_run &r : runs)
+            sorted[first[r.y - ymin]++] = r;
+        runs.swap(sorted);
+        auto by_start = [](const stroke_run &a, const stroke_run &b)
+        { return a.x0 != b.x0 ? a.x0 < b.x0 : a.alpha > b.alpha; };
+        size_t i = 0;
+        while (i < runs.size())
+        {
+            size_t end = i;
+            while (end < runs.size() && runs[end].y == runs[i].y)
+                ++end;
+            std::sort(runs.begin() + i, runs.begin() + end, by_start);
+            int y = runs[i].y;
+            int solid0 = 0, solid1 = std::numeric_limits<int>::min(); // pending merged solid span
+            for (; i < end; ++i)
+            {
+                const stroke_run &r = runs[i];
+                if (r.alpha == 255)
+                {
+                    if (r.x0 > solid1)
+                    {
+                        if (solid0 < solid1)
+                            sp ? sp_fill_span(solid0, solid1, y, color) : cov_fill_span(solid0, solid1, y, color);
+                        solid0 = r.x0;
+                    }
+                    solid1 = std::max(solid1, r.x1);
+                    continue;
+                }
+                if (r.x0 < solid1)
+                    continue;
+                // partial pixels only occur in coverage mode
+                int alpha = r.alpha;
+                while (i + 1 < end && runs[i + 1].x0 == r.x0)
+                    alpha = std::max(alpha, runs[++i].alpha);
+                blend_pixel(r.x0, y, color, alpha);
+            }
+            if (solid0 < solid1)
+                sp ? sp_fill_span(solid0, solid1, y, color) : cov_fill_span(solid0, solid1, y, color);
+        }
+    }
+
+    /* 1 pixel wide lines: Wu in coverage mode, in supersample mode a subpixel Bresenham SN samples thick
+     * the line is drawn in strips of one tile along its major axis, each strip touches only the tiles it reaches
+     */
+    template <typename Kernel>
+    void line_strips(const geo2d::line &l, int unit, double reach, const region &clip, Kernel &&kernel)
+    {
+        double x0 = l.start[0] * unit, y0 = l.start[1] * unit, x1 = l.stop[0] * unit, y1 = l.stop[1] * unit;
+        bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+        if (steep)
+        {
+            std::swap(x0, y0);
+            std::swap(x1, y1);
+        }
+        if (x0 > x1)
+        {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+        region c = {clip.x0 * unit, clip.y0 * unit, clip.x1 * unit, clip.y1 * unit};
+        int major0 = steep ? c.y0 : c.x0, major1 = steep ? c.y1 : c.x1;
+        int minor0 = steep ? c.x0 : c.y0, minor1 = steep ? c.x1 : c.y1;
+        int lo = std::max(static_cast<int>(std::floor(x0 - reach)), major0);
+        int hi = std::min(static_cast<int>(std::ceil(x1 + reach)) + 1, major1);
+        double g = x1 > x0 ? (y1 - y0) / (x1 - x0) : 0;
+        auto minor_at = [&](double m) { return y0 + (std::clamp(m, x0, x1) - x0) * g; };
+        int strip = TILE * unit;
+        for (int s = lo - (lo % strip + strip) % strip; s < hi; s += strip)
+        {
+            int m0 = std::max(s, lo), m1 = std::min(s + strip, hi);
+            double a = minor_at(m0), b = minor_at(m1);
+            int n0 = std::max(static_cast<int>(std::floor(std::min(a, b) - reach)), minor0);
+            int n1 = std::min(static_cast<int>(std::ceil(std::max(a, b) + reach)) + 1, minor1);
+            if (n0 >= n1)
+                continue;
+            lines::bounds piece = steep ? lines::bounds{n0, m0, n1, m1} : lines::bounds{m0, n0, m1, n1};
+            if (m_aa == AntiAlias::supersample)
+                touch_sp(piece.x0, piece.y0, piece.x1, piece.y1);
+            else
+                touch(piece.x0, piece.y0, piece.x1, piece.y1);
+            kernel(piece);
+        }
+    }
+
+    void draw_hairline(const geo2d::line &l, const paint &color, const region &clip)
+    {
+        if (m_aa == AntiAlias::coverage)
+        {
+            line_strips(l, 1, 2, clip,
+                        [&](const lines::bounds &piece)
+                        {
+                            lines::wu(l.start[0], l.start[1], l.stop[0], l.stop[1], piece,
+                                      [&](int x, int y, int alpha) { blend_pixel(x, y, color, alpha); });
+                        });
+            return;
+        }
+        line_strips(l, SN, SN / 2.0 + 1, clip,
+                    [&](const lines::bounds &piece)
+                    {
+                        lines::dda(double(l.start[0]) * SN, double(l.start[1]) * SN, double(l.stop[0]) * SN,
+                                   double(l.stop[1]) * SN, SN, piece,
+                                   [&](bool steep, int major, int m0, int m1)
+                                   {
+                                       if (steep)
+                                           return sp_fill_span(m0, m1, major, color);
+                                       uint8_t *p = sp_at(major, m0);
+                                       for (int m = m0; m < m1; ++m, p += sp_stride())
+                                       {
+                                           write_span(p, 1, color);
+                                       }
+                                   });
+                    });
+    }
+
+    // a recorded draw call, rasterized later per tile in deferred mode
+    struct ring
+    {
+        geo2d::circle circle;
+        float line_width;
+    };
+    struct ellipse_ring
+    {
+        geo2d::ellipse ellipse;
+        float line_width;
+    };
+    struct stroked_polyline
+    {
+        geo2d::polyline line;
+        stroke_style style;
+    };
+    // a piece of a deferred stroke, a convex polygon or a disk at pts[0] when n is 0
+    struct stroke_piece
+    {
+        vec2f pts[4];
+        int n;
+        uint32_t soft;
+    };
+    // the pieces of one stroke that reach one tile, m_piece_lists[first, first + count) index m_pieces
+    struct stroke_part
+    {
+        uint32_t first, count;
+        float half_width;
+        region area; // the tile, for binning
+    };
+    struct hairline
+    {
+        geo2d::line line;
+    };
+    struct thick_line
+    {
+        geo2d::line line;
+        float line_width;
+    };
+    struct command
+    {
+        std::variant<geo2d::circle, ring, geo2d::rect, geo2d::triangle, thick_line, geo2d::polygon, geo2d::ellipse,
+                     ellipse_ring, stamp, stroked_polyline, stroke_part, hairline>
+            shape;
+        paint color;
+    };
+    bool m_deferred = false;
+    std::vector<command> m_commands;
+    std::vector<std::vector<uint32_t>> m_bins; // command indices per tile, in submission order
+    std::vector<stroke_piece> m_pieces;        // pieces of deferred strokes, until the next flush
+    std::vector<uint32_t> m_piece_lists;
+
+    region full_region() const { return {0, 0, width(), height()}; }
+
+    // conservative pixel bounds of a command, not clipped
+    static region bounds(const command &cmd)
+    {
+        auto box = [](float cx, float cy, float ex, float ey) -> region
+        {
+            return {static_cast<int>(std::floor(cx - ex)) - 1, static_cast<int>(std::floor(cy - ey)) - 1,
+                    static_cast<int>(std::ceil(cx + ex)) + 1, static_cast<int>(std::ceil(cy + ey)) + 1};
+        };
+        return std::visit(
+            [&](const auto &sh) -> region
+            {
+                using T = std::decay_t<decltype(sh)>;
+                if constexpr (std::is_same_v<T, geo2d::circle>)
+                    return box(sh.center[0], sh.center[1], sh.radius, sh.radius);
+                else if constexpr (std::is_same_v<T, ring>)
+                {
+                    float R = sh.circle.radius + sh.line_width / 2;
+                    return box(sh.circle.center[0], sh.circle.center[1], R, R);
+                }
+                else if constexpr (std::is_same_v<T, geo2d::triangle> || std::is_same_v<T, geo2d::polygon>)
+                {
+                    if constexpr (std::is_same_v<T, geo2d::polygon>)
+                    {
+                        if (sh.points.empty())
+                            return {0, 0, 0, 0};
+                    }
+                    float cx = (sh.xmin() + sh.xmax()) / 2;
+                    float cy = (sh.ymin() + sh.ymax()) / 2;
+                    return box(cx, cy, sh.xmax() - cx, sh.ymax() - cy);
+                }
+                else if constexpr (std::is_same_v<T, geo2d::ellipse>)
+                {
+                    float ex, ey;
+                    ellipse_extent(sh.a, sh.b, sh.angle, ex, ey);
+                    return box(sh.center[0], sh.center[1], ex + 1, ey + 1);
+                }
+                else if constexpr (std::is_same_v<T, ellipse_ring>)
+                {
+                    float half = std::max(sh.line_width, 0.0f) / 2;
+                    float ex, ey;
+                    ellipse_extent(sh.ellipse.a + half, sh.ellipse.b + half, sh.ellipse.angle, ex, ey);
+                    return box(sh.ellipse.center[0], sh.ellipse.center[1], ex + 1, ey + 1);
+                }
+                else if constexpr (std::is_same_v<T, stamp> || std::is_same_v<T, stroke_part>)
+                    return sh.area;
+                else if constexpr (std::is_same_v<T, hairline>)
+                {
+                    float cx = (sh.line.start[0] + sh.line.stop[0]) / 2;
+                    float cy = (sh.line.start[1] + sh.line.stop[1]) / 2;
+                    return box(cx, cy, std::abs(sh.line.stop[0] - cx) + 2, std::abs(sh.line.stop[1] - cy) + 2);
+                }
+                else if constexpr (std::is_same_v<T, stroked_polyline>)
+                {
+                    if (sh.line.points.empty())
+                        return {0, 0, 0, 0};
+                    float xmin = sh.line.points[0][0], xmax = xmin, ymin = sh.line.points[0][1], ymax = ymin;
+                    for (const vec2f &p : sh.line.points)
+                    {
+                        xmin = std::min(xmin, p[0]);
+                        xmax = std::max(xmax, p[0]);
+                        ymin = std::min(ymin, p[1]);
+                        ymax = std::max(ymax, p[1]);
+                    }
+                    // miters reach miter_limit half widths, square caps sqrt(2)
+                    float pad = sh.style.width / 2 * std::max(sh.style.miter_limit, 1.5f) + 1;
+                    float cx = (xmin + xmax) / 2, cy = (ymin + ymax) / 2;
+                    return box(cx, cy, xmax - cx + pad, ymax - cy + pad);
+                }
+                else if constexpr (std::is_same_v<T, thick_line>)
+                {
+                    float e = sh.line_width;
+                    float cx = (sh.line.start[0] + sh.line.stop[0]) / 2;
+                    float cy = (sh.line.start[1] + sh.line.stop[1]) / 2;
+                    return box(cx, cy, std::abs(sh.line.stop[0] - cx) + e, std::abs(sh.line.stop[1] - cy) + e);
+                }
+                else
+                {
+                    float c = std::abs(std::cos(sh.angle));
+                    float s = std::abs(std::sin(sh.angle));
+                    float hw = sh.width / 2;
+                    float hh = sh.height / 2;
+                    return box(sh.center[0], sh.center[1], hw * c + hh * s, hw * s + hh * c);
+                }
+            },
+            cmd.shape);
+    }
+
+    void rasterize(const command &cmd, const region &clip)
+    {
+        std::visit(
+            [&](const auto &sh)
+            {
+                using T = std::decay_t<decltype(sh)>;
+                if constexpr (std::is_same_v<T, geo2d::circle>)
+                {
+                    if (m_aa == AntiAlias::coverage)
+                        cov_fill_annulus(sh.center, 0, sh.radius, cmd.color, clip);
+                    else
+                        sp_fill_annulus(sh.center, 0, sh.radius, cmd.color, clip);
+                }
+                else if constexpr (std::is_same_v<T, ring>)
+                {
+                    float R1 = sh.circle.radius - sh.line_width / 2;
+                    float R2 = sh.circle.radius + sh.line_width / 2;
+                    if (m_aa == AntiAlias::coverage)
+                        cov_fill_annulus(sh.circle.center, R1, R2, cmd.color, clip);
+                    else
+                        sp_fill_annulus(sh.circle.center, R1, R2, cmd.color, clip);
+                }
+                else if constexpr (std::is_same_v<T, geo2d::triangle>)
+                {
+                    if (m_aa == AntiAlias::coverage)
+                    {
+                        vec2f pts[3] = {sh.a, sh.b, sh.c};
+                        cov_fill_convex(pts, 3, cmd.color, clip);
+                    }
+                    else
+                        sp_fill_triangle(sh, cmd.color, clip);
+                }
+                else if constexpr (std::is_same_v<T, geo2d::ellipse>)
+                {
+                    if (m_aa == AntiAlias::coverage)
+                        cov_fill_ellipse(sh, 0, cmd.color, clip);
+                    else
+                        sp_fill_ellipse(sh, 0, cmd.color, clip);
+                }
+                else if constexpr (std::is_same_v<T, ellipse_ring>)
+                {
+                    if (m_aa == AntiAlias::coverage)
+                        cov_fill_ellipse(sh.ellipse, sh.line_width, cmd.color, clip);
+                    else
+                        sp_fill_ellipse(sh.ellipse, sh.line_width, cmd.color, clip);
+                }
+                else if constexpr (std::is_same_v<T, stamp>)
+                    blit_stamp(sh, cmd.color, clip);
+                else if constexpr (std::is_same_v<T, hairline>)
+                    draw_hairline(sh.line, cmd.color, clip);
+                else if constexpr (std::is_same_v<T, stroked_polyline>)
+                    stroke_polyline(sh.line, sh.style, cmd.color, clip);
+                else if constexpr (std::is_same_v<T, stroke_part>)
+                {
+                    region rc = {std::max(clip.x0, sh.area.x0), std::max(clip.y0, sh.area.y0),
+                                 std::min(clip.x1, sh.area.x1), std::min(clip.y1, sh.area.y1)};
+                    if (rc.x0 >= rc.x1 || rc.y0 >= rc.y1)
+                        return;
+                    const uint32_t *list = m_piece_lists.data() + sh.first;
+                    stroke_merged(sh.half_width, cmd.color, rc,
+                                  [&](auto &&convex, auto &&disk)
+                                  {
+                                      for (uint32_t k = 0; k < sh.count; ++k)
+                                      {
+                                          const stroke_piece &p = m_pieces[list[k]];
+                                          if (p.n)
+                                              convex(p.pts, p.n, p.soft);
+                                          else
+                                              disk(p.pts[0]);
+                                      }
+                                  });
+                }
+                else if constexpr (std::is_same_v<T, thick_line>)
+                {
+                    if (m_aa == AntiAlias::coverage)
+                        cov_fill_thick_line(sh.line, sh.line_width, cmd.color, clip);
+                    else
+                    {
+                        auto pts = line_corners(sh.line, sh.line_width);
+                        sp_fill_convex(pts.data(), 4, cmd.color, clip);
+                    }
+                }
+                else if constexpr (std::is_same_v<T, geo2d::polygon>)
+                {
+                    int n = static_cast<int>(sh.points.size());
+                    if (n < 3)
+                        return;
+                    if (m_aa == AntiAlias::coverage)
+                        cov_fill_convex(sh.points.data(), n, cmd.color, clip);
+                    else
+                        sp_fill_convex(sh.points.data(), n, cmd.color, clip);
+                }
+                else
+                {
+                    if (m_aa == AntiAlias::coverage)
+                        cov_fill_rect(sh, cmd.color, clip);
+                    else
+                    {
+                        auto pts = rect_corners(sh);
+                        sp_fill_convex(pts.data(), 4, cmd.color, clip);
+                    }
+                }
+            },
+            cmd.shape);
+    }
+
+    /* deferred from beginpaint to the first access of the pixels
+     * a frame that starts by clearing every tile writes all of them again and skips the copy
+     */
+    void catch_up()
+    {
+        if (m_catch_up)
+            m_canvas.beginpaint();
+        m_catch_up = false;
+    }
+
+    /* a deferred stroke is cut into pieces once, each tile gets a part listing only the pieces that reach it
+     * so a tile does not stroke the whole polyline again
+     */
+    void submit_stroke(const stroked_polyline &sh, const paint &color)
+    {
+        float hw = sh.style.width / 2;
+        thread_local std::vector<uint64_t> hits; // tile << 32 | piece
+        hits.clear();
+        auto add = [&](const stroke_piece &p, float xmin, float xmax, float ymin, float ymax)
+        {
+            int x0 = std::max(static_cast<int>(std::floor(xmin)) - 1, 0);
+            int y0 = std::max(static_cast<int>(std::floor(ymin)) - 1, 0);
+            int x1 = std::min(static_cast<int>(std::ceil(xmax)) + 1, width());
+            int y1 = std::min(static_cast<int>(std::ceil(ymax)) + 1, height());
+            if (x0 >= x1 || y0 >= y1)
+                return;
+            uint64_t piece = m_pieces.size();
+            m_pieces.push_back(p);
+            for (int ty = y0 / TILE; ty <= (y1 - 1) / TILE; ++ty)
+            {
+                for (int tx = x0 / TILE; tx <= (x1 - 1) / TILE; ++tx)
+                {
+                    hits.push_back(static_cast<uint64_t>(ty * m_tiles_x + tx) << 32 | piece);
+                }
+            }
+        };
+        stroke_pieces(
+            sh.line, sh.style,
+            [&](const vec2f *pts, int n, uint32_t soft)
+            {
+                stroke_piece p{{}, n, soft};
+                float xmin = pts[0][0], xmax = xmin, ymin = pts[0][1], ymax = ymin;
+                for (int k = 0; k < n; ++k)
+                {
+                    p.pts[k] = pts[k];
+                    xmin = std::min(xmin, pts[k][0]);
+                    xmax = std::max(xmax, pts[k][0]);
+                    ymin = std::min(ymin, pts[k][1]);
+                    ymax = std::max(ymax, pts[k][1]);
+                }
+                add(p, xmin, xmax, ymin, ymax);
+            },
+            [&](vec2f c) { add({{c}, 0, 0}, c[0] - hw, c[0] + hw, c[1] - hw, c[1] + hw); });
+        std::sort(hits.begin(), hits.end());
+        for (size_t i = 0; i < hits.size();)
+        {
+            uint32_t tile = static_cast<uint32_t>(hits[i] >> 32);
+            uint32_t first = static_cast<uint32_t>(m_piece_lists.size());
+            for (; i < hits.size() && hits[i] >> 32 == tile; ++i)
+            {
+                m_piece_lists.push_back(static_cast<uint32_t>(hits[i]));
+            }
+            region area = tile_region(tile % m_tiles_x, tile / m_tiles_x);
+            uint32_t index = static_cast<uint32_t>(m_commands.size());
+            m_commands.push_back({stroke_part{first, static_cast<uint32_t>(m_piece_lists.size()) - first, hw, area},
+                                  color});
+            m_bins[tile].push_back(index);
+        }
+    }
+
+    /* rasterize now, or record and bin by bounding box in deferred mode
+     * without a thread pool tiles gain nothing, commands are only recorded and run in order over the whole canvas
+     */
+    void submit(command cmd)
+    {
+        catch_up();
+        if (!m_deferred)
+            return rasterize(cmd, full_region());
+        if (!m_pool)
+        {
+            m_commands.push_back(std::move(cmd));
+            return;
+        }
+        if (auto *sh = std::get_if<stroked_polyline>(&cmd.shape))
+            return submit_stroke(*sh, cmd.color);
+        region rc = bounds(cmd);
+        int x0 = std::max(rc.x0, 0), y0 = std::max(rc.y0, 0);
+        int x1 = std::min(rc.x1, width()), y1 = std::min(rc.y1, height());
+        if (x0 >= x1 || y0 >= y1)
+            return;
+        uint32_t index = static_cast<uint32_t>(m_commands.size());
+        m_commands.push_back(std::move(cmd));
+        for (int ty = y0 / TILE; ty <= (y1 - 1) / TILE; ++ty)
+        {
+            for (int tx = x0 / TILE; tx <= (x1 - 1) / TILE; ++tx)
+            {
+                m_bins[ty * m_tiles_x + tx].push_back(index);
+            }
+        }
+    }
+
+    // rasterize the recorded commands, every tile runs its bin in submission order on one worker of the pool
+    void flush_commands()
+    {
+        if (m_commands.empty())
+            return;
+        ScopedTimer timer(Phase::rasterize);
+        if (!m_pool)
+        {
+            for (const command &cmd : m_commands)
+            {
+                rasterize(cmd, full_region());
+            }
+            m_commands.clear();
+            return;
+        }
+        auto run_bin = [this](int i)
+        {
+            auto &bin = m_bins[i];
+            region clip = tile_region(i % m_tiles_x, i / m_tiles_x);
+            for (uint32_t index : bin)
+            {
+                rasterize(m_commands[index], clip);
+            }
+            bin.clear();
+        };
+        m_pool->parallel_for(0, m_tiles_x * m_tiles_y, run_bin);
+        m_commands.clear();
+        m_pieces.clear();
+        m_piece_lists.clear();
+    }
+
+    void discard_commands()
+    {
+        for (auto &bin : m_bins)
+        {
+            bin.clear();
+        }
+        m_commands.clear();
+        m_pieces.clear();
+        m_piece_lists.clear();
+    }
+
+  public:
+    BasicCanvas(int width, int height, AntiAlias aa = AntiAlias::supersample)
+        : m_canvas(width, height), m_aa(aa), m_subpixels(nullptr), m_tiles_x((width + TILE - 1) / TILE),
+          m_tiles_y((height + TILE - 1) / TILE), m_tiles(m_tiles_x * m_tiles_y, tile_state{true, true, rgb::black()}),
+          m_bins(m_tiles_x * m_tiles_y)
+    {
+        if (has_subpixels())
+            m_subpixels = simd::alloc_rows(sp_stride() * sp_height());
+    }
+    ~BasicCanvas()
+    {
+        if (m_subpixels)
+            simd::free_rows(m_subpixels);
+    }
+
+    static constexpr int samples() { return SN; }
+    RawCanvas &get_raw_canvas()
+    {
+        catch_up();
+        return m_canvas;
+    }
+    int width() const { return m_canvas.width(); }
+    int height() const { return m_canvas.height(); }
+    AntiAlias antialias() const { return m_aa; }
+    // number of threads used to rasterize bins and resolve tiles, 1 runs on the calling thread
+    void set_threads(int n)
+    {
+        flush_commands(); // recorded commands are binned for the current pool
+        m_pool = n > 1 ? std::make_unique<ThreadPool>(n) : nullptr;
+    }
+    int threads() const { return m_pool ? m_pool->size() : 1; }
+    /* in deferred mode draw calls are recorded and binned into tiles, then rasterized in parallel by endpaint
+     * it pays off with more than one thread and frames of many primitives, with one thread it only delays drawing
+     * immediate mode is the default and the faster choice for a single thread
+     */
+    void set_deferred(bool deferred)
+    {
+        if (!deferred)
+            flush_commands();
+        m_deferred = deferred;
+    }
+    bool deferred() const { return m_deferred; }
+    void beginpaint() { m_catch_up = true; }
+    void endpaint()
+    {
+        catch_up();
+        flush_commands();
+        if (m_stamp_size > STAMP_BUDGET)
+        {
+            m_stamps.clear();
+            m_stamp_size = 0;
+        }
+        flush_tiles();
+        m_canvas.endpaint(m_damage);
+    }
+    // clearing only flags the tiles, pixels are written when a tile is drawn on or resolved
+    void fill(rgb color)
+    {
+        discard_commands();
+        bool redraw_all = true;
+        for (tile_state &t : m_tiles)
+        {
+            if (t.cleared && t.clear == color)
+            {
+                redraw_all = redraw_all && t.dirty;
+                continue;
+            }
+            t.cleared = true;
+            t.dirty = true;
+            t.clear = color;
+        }
+        if (m_catch_up)
+            m_canvas.beginpaint(redraw_all);
+        m_catch_up = false;
+    }
+    void save_bmp(const char *filename)
+    {
+        catch_up();
+        flush_commands();
+        flush_tiles();
+        m_canvas.save_bmp(filename);
+    }
+
+    void fill(const geo2d::circle &c, rgb color) { submit({c, color}); }
+
+    void draw(const geo2d::circle &c, float line_width, rgb color) { submit({ring{c, line_width}, color}); }
+
+    void fill(const geo2d::triangle &t, rgb color) { submit({t, color}); }
+
+    void fill(const geo2d::rect &r, rgb color) { submit({r, color}); }
+
+    void draw(const geo2d::line &l, float line_width, rgb color) { submit({thick_line{l, line_width}, color}); }
+
+    // 1 pixel wide lines, far cheaper than a width 1 draw for wireframes and plots
+    void draw(const geo2d::line &l, rgb color) { submit({hairline{l}, color}); }
+    void draw_lines(std::span<const geo2d::line> segments, rgb color)
+    {
+        for (const geo2d::line &l : segments)
+        {
+            submit({hairline{l}, color});
+        }
+    }
+    // the polygon must be convex
+    void fill(const geo2d::polygon &p, rgb color) { submit({p, color}); }
+
+    void fill(const geo2d::ellipse &e, rgb color) { submit({e, color}); }
+
+    // the whole polyline is stroked at once, joins have no gaps and no pixel is drawn twice
+    void draw(const geo2d::polyline &p, const stroke_style &style, rgb color)
+    {
+        submit({stroked_polyline{p, style}, color});
+    }
+
+    // copies of c at c.center + offsets[i], each blits a cached mask instead of rasterizing the circle again
+    void fill_instanced(const geo2d::circle &c, std::span<const vec2f> offsets, rgb color)
+    {
+        stamp_instances(0, c.radius, c.center, offsets, color);
+    }
+    void draw_instanced(const geo2d::circle &c, float line_width, std::span<const vec2f> offsets, rgb color)
+    {
+        stamp_instances(c.radius - line_width / 2, c.radius + line_width / 2, c.center, offsets, color);
+    }
+
+    // the outline is the band between the ellipses with both semi-axes grown and shrunk by line_width / 2
+    void draw(const geo2d::ellipse &e, float line_width, rgb color) { submit({ellipse_ring{e, line_width}, color}); }
+
+    // translucent versions, color is premultiplied
+    void fill(const geo2d::circle &c, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({c, paint(color, mode)});
+    }
+    void draw(const geo2d::circle &c, float line_width, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({ring{c, line_width}, paint(color, mode)});
+    }
+    void fill(const geo2d::triangle &t, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({t, paint(color, mode)});
+    }
+    void fill(const geo2d::rect &r, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({r, paint(color, mode)});
+    }
+    void draw(const geo2d::line &l, float line_width, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({thick_line{l, line_width}, paint(color, mode)});
+    }
+    void fill(const geo2d::polygon &p, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({p, paint(color, mode)});
+    }
+    void fill(const geo2d::ellipse &e, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({e, paint(color, mode)});
+    }
+    void draw(const geo2d::ellipse &e, float line_width, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({ellipse_ring{e, line_width}, paint(color, mode)});
+    }
+    void draw(const geo2d::polyline &p, const stroke_style &style, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({stroked_polyline{p, style}, paint(color, mode)});
+    }
+    void draw(const geo2d::line &l, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        submit({hairline{l}, paint(color, mode)});
+    }
+    void draw_lines(std::span<const geo2d::line> segments, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        for (const geo2d::line &l : segments)
+        {
+            submit({hairline{l}, paint(color, mode)});
+        }
+    }
+    void fill_instanced(const geo2d::circle &c, std::span<const vec2f> offsets, rgba color,
+                        BlendMode mode = BlendMode::src_over)
+    {
+        stamp_instances(0, c.radius, c.center, offsets, paint(color, mode));
+    }
+    void draw_instanced(const geo2d::circle &c, float line_width, std::span<const vec2f> offsets, rgba color,
+                        BlendMode mode = BlendMode::src_over)
+    {
+        stamp_instances(c.radius - line_width / 2, c.radius + line_width / 2, c.center, offsets, paint(color, mode));
+    }
+};
+
+using Canvas = BasicCanvas<4>;
 
 } // end namespace games
 
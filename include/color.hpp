@@ -82,6 +82,38 @@ inline rgb mix(double k, const rgb &c1, const rgb &c2)
             static_cast<uint8_t>(c1.b * k + c2.b * (1 - k))};
 }
 
+// premultiplied color with alpha, r, g and b are already scaled by a
+struct rgba
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+
+    static rgba from(const rgb &c, uint8_t alpha = 255)
+    {
+        return {static_cast<uint8_t>((c.r * alpha + 127) / 255), static_cast<uint8_t>((c.g * alpha + 127) / 255),
+                static_cast<uint8_t>((c.b * alpha + 127) / 255), alpha};
+    }
+    static rgba from_opacity(const rgb &c, double opacity)
+    {
+        return from(c, static_cast<uint8_t>(std::clamp(opacity, 0.0, 1.0) * 255 + 0.5));
+    }
+    rgb color() const { return {r, g, b}; }
+};
+
+inline bool operator==(const rgba &c1, const rgba &c2)
+{
+    return c1.r == c2.r && c1.g == c2.g && c1.b == c2.b && c1.a == c2.a;
+}
+inline bool operator!=(const rgba &c1, const rgba &c2) { return !(c1 == c2); }
+
+enum class BlendMode
+{
+    src_over, // dst = src + dst * (1 - src.a)
+    additive, // dst = min(dst + src, 1)
+};
+
 } // end namespace games
 
 #endif // GAMES_COLOR_HPP
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+#ifndef GAMES_EXPORT_QUEUE_HPP
+#define GAMES_EXPORT_QUEUE_HPP
+
+#include "profiler.hpp"
+#include "raw_canvas.hpp"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace games
+{
+
+/* writes frames to image files on a background thread
+ * submit copies the frame into one of capacity pooled buffers and returns, when all of them are queued or being
+ * written it waits for one to come back, so a slow disk slows the producer down instead of piling up memory
+ */
+class ExportQueue
+{
+  private:
+    struct job
+    {
+        std::vector<uint8_t> pixels;
+        std::ptrdiff_t stride;
+        int width;
+        int height;
+        std::string path;
+    };
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv_job;
+    std::condition_variable m_cv_free;
+    std::deque<job> m_jobs;
+    std::vector<std::vector<uint8_t>> m_pool;
+    int m_copying = 0; // submits copying a frame outside the lock, not queued yet
+    int m_busy = 0;    // jobs taken by the worker and not finished yet
+    int m_failed = 0;
+    bool m_stop = false;
+    std::thread m_worker;
+
+    ExportQueue(const ExportQueue &) = delete;
+    ExportQueue &operator=(const ExportQueue &) = delete;
+
+    void work()
+    {
+        prof::set_thread_name("export");
+        std::unique_lock<std::mutex> lock(m_mtx);
+        while (true)
+        {
+            m_cv_job.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+            if (m_jobs.empty())
+                return;
+            job j = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            ++m_busy;
+            lock.unlock();
+            bool ok;
+            {
+                ScopedTimer timer(Phase::save);
+                ok = write_bmp(j.path.c_str(), j.pixels.data(), j.stride, j.width, j.height);
+            }
+            lock.lock();
+            --m_busy;
+            m_failed += !ok;
+            m_pool.push_back(std::move(j.pixels));
+            m_cv_free.notify_all();
+        }
+    }
+
+    // copy the visible part of each row, lock is held and a pooled buffer is free
+    void enqueue(std::unique_lock<std::mutex> &lock, const frame_view &frame, std::string path)
+    {
+        job j{std::move(m_pool.back()), simd::PIXEL_BYTES * std::ptrdiff_t(frame.width), frame.width, frame.height,
+              std::move(path)};
+        m_pool.pop_back();
+        ++m_copying;
+        lock.unlock();
+        j.pixels.resize(j.stride * j.height);
+        for (int y = 0; y < frame.height; ++y)
+        {
+            std::memcpy(j.pixels.data() + y * j.stride, frame.pixels + y * frame.stride, j.stride);
+        }
+        lock.lock();
+        --m_copying;
+        m_jobs.push_back(std::move(j));
+        m_cv_job.notify_one();
+    }
+
+  public:
+    explicit ExportQueue(int capacity = 4) : m_pool(capacity > 0 ? capacity : 1)
+    {
+        m_worker = std::thread([this] { work(); });
+    }
+
+    // writes everything still queued, then stops the worker
+    ~ExportQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_stop = true;
+        }
+        m_cv_job.notify_one();
+        m_worker.join();
+    }
+
+    // snapshot frame to be written to path as a BMP, blocks while every pooled buffer is in use
+    void submit(const frame_view &frame, std::string path)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv_free.wait(lock, [this] { return !m_pool.empty(); });
+        enqueue(lock, frame, std::move(path));
+    }
+
+    // same as submit, but drops the frame and returns false instead of waiting
+    bool try_submit(const frame_view &frame, std::string path)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (m_pool.empty())
+            return false;
+        enqueue(lock, frame, std::move(path));
+        return true;
+    }
+
+    // block until every submitted frame is written
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv_free.wait(lock, [this] { return m_copying == 0 && m_jobs.empty() && m_busy == 0; });
+    }
+
+    // number of frames whose file could not be written
+    int failed()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_failed;
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_EXPORT_QUEUE_HPP
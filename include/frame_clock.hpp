@@ -0,0 +1,92 @@
+#pragma once
+#ifndef GAMES_FRAME_CLOCK_HPP
+#define GAMES_FRAME_CLOCK_HPP
+
+#include "profiler.hpp"
+#include <chrono>
+#include <thread>
+
+namespace games
+{
+
+/* paces a producer loop: the simulation advances in fixed steps of wall clock time, rendering is capped at fps
+ * tick() sleeps until the next frame is due and returns the steps to simulate before drawing it
+ */
+class FrameClock
+{
+  public:
+    struct frame
+    {
+        int steps;    // fixed steps to simulate before rendering this frame
+        int skipped;  // steps dropped because the simulation fell more than max_steps behind
+        double alpha; // how far the render time lies between the last two simulated states, in [0, 1)
+    };
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    clock::duration m_step;
+    clock::duration m_period; // zero renders uncapped
+    int m_max_steps;
+    clock::time_point m_last;
+    clock::time_point m_next;
+    clock::duration m_lag;
+
+  public:
+    // step and 1 / fps in seconds, fps <= 0 leaves the render rate uncapped
+    FrameClock(double step, double fps = 0, int max_steps = 5)
+        : m_step(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(step))),
+          m_period(fps > 0 ? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1 / fps))
+                           : clock::duration::zero()),
+          m_max_steps(max_steps)
+    {
+        reset();
+    }
+
+    // forget the elapsed time, after a pause for example
+    void reset()
+    {
+        m_last = clock::now();
+        m_next = m_last;
+        m_lag = clock::duration::zero();
+    }
+
+    frame tick()
+    {
+        auto now = clock::now();
+        if (m_period > clock::duration::zero())
+        {
+            if (now < m_next)
+            {
+                ScopedTimer timer(Phase::wait);
+                std::this_thread::sleep_until(m_next);
+                now = clock::now();
+            }
+            // keep the phase when slightly late, start over when a whole period behind
+            m_next += m_period;
+            if (m_next <= now)
+                m_next = now + m_period;
+        }
+        m_lag += now - m_last;
+        m_last = now;
+        int steps = static_cast<int>(m_lag / m_step);
+        m_lag -= steps * m_step;
+        int skipped = 0;
+        if (steps > m_max_steps)
+        {
+            skipped = steps - m_max_steps;
+            steps = m_max_steps;
+        }
+        return {steps, skipped, std::chrono::duration<double>(m_lag) / m_step};
+    }
+
+    double step() const { return std::chrono::duration<double>(m_step).count(); }
+    double fps() const
+    {
+        return m_period > clock::duration::zero() ? 1 / std::chrono::duration<double>(m_period).count() : 0;
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_FRAME_CLOCK_HPP
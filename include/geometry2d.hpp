@@ -3,6 +3,9 @@
 #define GAMES_GEOMETRY2D_HPP
 
 #include "mat.hpp"
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
 
 namespace games
 {
@@ -57,6 +60,39 @@ struct triangle
     float ymin() const { return std::min({a[1], b[1], c[1]}); }
 };
 
+// open or closed chain of points, stroked by Canvas::draw
+struct polyline
+{
+    std::vector<vec2f> points;
+    bool closed;
+
+    polyline(std::initializer_list<vec2f> pts, bool closed = false) : points(pts), closed(closed) {}
+    explicit polyline(std::vector<vec2f> pts, bool closed = false) : points(std::move(pts)), closed(closed) {}
+};
+
+// convex polygon, points in either winding order
+struct polygon
+{
+    std::vector<vec2f> points;
+
+    polygon(std::initializer_list<vec2f> pts) : points(pts) {}
+    explicit polygon(std::vector<vec2f> pts) : points(std::move(pts)) {}
+    float xmax() const { return extent(0, [](float a, float b) { return std::max(a, b); }); }
+    float xmin() const { return extent(0, [](float a, float b) { return std::min(a, b); }); }
+    float ymax() const { return extent(1, [](float a, float b) { return std::max(a, b); }); }
+    float ymin() const { return extent(1, [](float a, float b) { return std::min(a, b); }); }
+
+  private:
+    template <typename F>
+    float extent(int axis, F f) const
+    {
+        float v = points.empty() ? 0.0f : points[0][axis];
+        for (const auto &p : points)
+            v = f(v, p[axis]);
+        return v;
+    }
+};
+
 struct rect
 {
     float height;
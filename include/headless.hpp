@@ -0,0 +1,74 @@
+#pragma once
+#ifndef GAMES_HEADLESS_HPP
+#define GAMES_HEADLESS_HPP
+
+#include "profiler.hpp"
+#include "raw_canvas.hpp"
+#include <atomic>
+#include <chrono>
+
+namespace games
+{
+
+// the producer loop of a window application without the window, frames are rendered back to back
+class HeadlessDriver
+{
+  public:
+    struct stats
+    {
+        int frames;
+        double seconds;
+        double fps() const { return seconds > 0 ? frames / seconds : 0; }
+    };
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    RawCanvas &m_canvas;
+    std::atomic<bool> m_stop{false};
+
+    HeadlessDriver(const HeadlessDriver &) = delete;
+    HeadlessDriver &operator=(const HeadlessDriver &) = delete;
+
+    // frame(i) draws and publishes frame i, the newest frame is presented after each one as to_dc would
+    template <typename F>
+    stats loop(F &&frame, int frames, clock::duration limit)
+    {
+        m_stop = false;
+        auto start = clock::now();
+        int n = 0;
+        for (; (frames <= 0 || n < frames) && !m_stop.load(std::memory_order_relaxed); ++n)
+        {
+            if (frames <= 0 && clock::now() - start >= limit)
+                break;
+            ScopedTimer timer(Phase::frame);
+            frame(n);
+            m_canvas.present();
+        }
+        return {n, std::chrono::duration<double>(clock::now() - start).count()};
+    }
+
+  public:
+    explicit HeadlessDriver(RawCanvas &canvas) : m_canvas(canvas) {}
+
+    // run a fixed number of frames, or until stop() when frames <= 0
+    template <typename F>
+    stats run(F &&frame, int frames)
+    {
+        return loop(frame, frames, clock::duration::max());
+    }
+
+    // run uncapped for a wall clock duration, or until stop()
+    template <typename F>
+    stats run_for(F &&frame, double seconds)
+    {
+        return loop(frame, 0, std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds)));
+    }
+
+    // ends the running loop after the current frame, callable from any thread
+    void stop() { m_stop = true; }
+};
+
+} // end namespace games
+
+#endif // GAMES_HEADLESS_HPP
@@ -0,0 +1,223 @@
+#pragma once
+#ifndef GAMES_LINES_HPP
+#define GAMES_LINES_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace games
+{
+
+/* thin line kernels shared by RawCanvas and Canvas
+ * pixel (or sample) i has its center at i + 0.5, kernels only report pixels inside the clip box, and the result
+ * of a pixel does not depend on the clip box, so tiles can draw a line piece by piece
+ */
+namespace lines
+{
+
+// [x0, x1) x [y0, y1)
+struct bounds
+{
+    int x0, y0, x1, y1;
+};
+
+enum : int
+{
+    inside = 0,
+    left = 1,
+    right = 2,
+    top = 4,
+    bottom = 8,
+};
+
+inline int outcode(double x, double y, double xmin, double ymin, double xmax, double ymax)
+{
+    int code = inside;
+    if (x < xmin)
+        code |= left;
+    else if (x > xmax)
+        code |= right;
+    if (y < ymin)
+        code |= top;
+    else if (y > ymax)
+        code |= bottom;
+    return code;
+}
+
+// Cohen-Sutherland, moves the ends onto [xmin, xmax] x [ymin, ymax], false if the segment misses it
+inline bool clip(double &x0, double &y0, double &x1, double &y1, double xmin, double ymin, double xmax, double ymax)
+{
+    int c0 = outcode(x0, y0, xmin, ymin, xmax, ymax);
+    int c1 = outcode(x1, y1, xmin, ymin, xmax, ymax);
+    while (true)
+    {
+        if (!(c0 | c1))
+            return true;
+        if (c0 & c1)
+            return false;
+        int c = c0 ? c0 : c1;
+        double x, y;
+        if (c & bottom)
+        {
+            x = x0 + (x1 - x0) * (ymax - y0) / (y1 - y0);
+            y = ymax;
+        }
+        else if (c & top)
+        {
+            x = x0 + (x1 - x0) * (ymin - y0) / (y1 - y0);
+            y = ymin;
+        }
+        else if (c & right)
+        {
+            y = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
+            x = xmax;
+        }
+        else
+        {
+            y = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
+            x = xmin;
+        }
+        if (c == c0)
+        {
+            x0 = x;
+            y0 = y;
+            c0 = outcode(x0, y0, xmin, ymin, xmax, ymax);
+        }
+        else
+        {
+            x1 = x;
+            y1 = y;
+            c1 = outcode(x1, y1, xmin, ymin, xmax, ymax);
+        }
+    }
+}
+
+// the line in major / minor coordinates, the major axis is the longer one and runs forward
+struct oriented
+{
+    double x0, y0, x1, y1;
+    bool steep;
+    int major0, major1, minor0, minor1; // clip box
+
+    oriented(double ax, double ay, double bx, double by, const bounds &clip)
+        : x0(ax), y0(ay), x1(bx), y1(by), steep(std::abs(by - ay) > std::abs(bx - ax))
+    {
+        if (steep)
+        {
+            std::swap(x0, y0);
+            std::swap(x1, y1);
+        }
+        if (x0 > x1)
+        {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+        major0 = steep ? clip.y0 : clip.x0;
+        major1 = steep ? clip.y1 : clip.x1;
+        minor0 = steep ? clip.x0 : clip.y0;
+        minor1 = steep ? clip.x1 : clip.y1;
+    }
+    double gradient() const { return x1 > x0 ? (y1 - y0) / (x1 - x0) : 0; }
+
+    // major range [first, last] of the segment within reach of the clip box, false if it misses
+    bool reach(double margin, int &first, int &last) const
+    {
+        double a = x0, b = y0, c = x1, d = y1;
+        if (!clip(a, b, c, d, major0 - margin, minor0 - margin, major1 + margin, minor1 + margin))
+            return false;
+        first = static_cast<int>(std::floor(a - margin));
+        last = static_cast<int>(std::ceil(c + margin));
+        return true;
+    }
+};
+
+/* aliased line `thickness` samples thick across its major axis (subpixel Bresenham)
+ * every major sample whose center lies in [start, stop) gets the thickness samples centered on the line,
+ * the minor start is stepped in 16.16 fixed point from the unclipped line, so it is exact for any clip
+ * run(steep, major, minor0, minor1) receives non-empty clipped runs, for steep lines major is y
+ */
+template <typename Run>
+void dda(double ax, double ay, double bx, double by, int thickness, const bounds &clip, Run &&run)
+{
+    static constexpr int64_t ONE = int64_t(1) << 16;
+    oriented l(ax, ay, bx, by, clip);
+    int first, last;
+    if (!l.reach(thickness + 1, first, last))
+        return;
+    int c0 = std::max({static_cast<int>(std::ceil(l.x0 - 0.5)), first, l.major0});
+    int c1 = std::min({static_cast<int>(std::ceil(l.x1 - 0.5)), last + 1, l.major1});
+    double g = l.gradient();
+    // the first covered minor sample of column c is ceil(base + c * step)
+    int64_t base = std::llround((l.y0 + (0.5 - l.x0) * g - thickness / 2.0 - 0.5) * ONE);
+    int64_t step = std::llround(g * ONE);
+    for (int c = c0; c < c1; ++c)
+    {
+        int m = static_cast<int>((base + int64_t(c) * step + ONE - 1) >> 16);
+        int m0 = std::max(m, l.minor0);
+        int m1 = std::min(m + thickness, l.minor1);
+        if (m0 < m1)
+            run(l.steep, c, m0, m1);
+    }
+}
+
+/* Xiaolin Wu's anti-aliased line, two pixels per major step weighted by the distance to the line
+ * plot(x, y, alpha) receives alpha in 1..255 for pixels inside the clip box
+ */
+template <typename Plot>
+void wu(double ax, double ay, double bx, double by, const bounds &clip, Plot &&plot)
+{
+    // Wu works on pixel centers
+    oriented l(ax - 0.5, ay - 0.5, bx - 0.5, by - 0.5, clip);
+    auto put = [&](int major, int minor, double cov)
+    {
+        int alpha = static_cast<int>(cov * 255 + 0.5);
+        if (alpha <= 0 || major < l.major0 || major >= l.major1 || minor < l.minor0 || minor >= l.minor1)
+            return;
+        if (l.steep)
+            plot(minor, major, std::min(alpha, 255));
+        else
+            plot(major, minor, std::min(alpha, 255));
+    };
+    auto frac = [](double v) { return v - std::floor(v); };
+    double g = l.x1 > l.x0 ? l.gradient() : 1;
+    // the end columns are weighted by how much of them the segment covers
+    double xend = std::round(l.x0);
+    double yend = l.y0 + g * (xend - l.x0);
+    double xgap = 1 - frac(l.x0 + 0.5);
+    int xp1 = static_cast<int>(xend);
+    if (xp1 == static_cast<int>(std::round(l.x1)))
+    {
+        // both ends in one column, which the segment covers over its length, at its midpoint
+        double len = l.x1 - l.x0, ymid = (l.y0 + l.y1) / 2;
+        put(xp1, static_cast<int>(std::floor(ymid)), (1 - frac(ymid)) * len);
+        put(xp1, static_cast<int>(std::floor(ymid)) + 1, frac(ymid) * len);
+        return;
+    }
+    put(xp1, static_cast<int>(std::floor(yend)), (1 - frac(yend)) * xgap);
+    put(xp1, static_cast<int>(std::floor(yend)) + 1, frac(yend) * xgap);
+    xend = std::round(l.x1);
+    yend = l.y1 + g * (xend - l.x1);
+    xgap = frac(l.x1 + 0.5);
+    int xp2 = static_cast<int>(xend);
+    put(xp2, static_cast<int>(std::floor(yend)), (1 - frac(yend)) * xgap);
+    put(xp2, static_cast<int>(std::floor(yend)) + 1, frac(yend) * xgap);
+    int first, last;
+    if (!l.reach(2, first, last))
+        return;
+    for (int x = std::max(xp1 + 1, first); x <= std::min(xp2 - 1, last); ++x)
+    {
+        double y = l.y0 + g * (x - l.x0);
+        int iy = static_cast<int>(std::floor(y));
+        double f = y - iy;
+        put(x, iy, 1 - f);
+        put(x, iy + 1, f);
+    }
+}
+
+} // namespace lines
+
+} // end namespace games
+
+#endif // GAMES_LINES_HPP
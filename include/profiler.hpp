@@ -0,0 +1,386 @@
+#pragma once
+#ifndef GAMES_PROFILER_HPP
+#define GAMES_PROFILER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace games
+{
+
+// the parts of a frame that are timed
+enum class Phase : uint8_t
+{
+    frame,     // one iteration of a producer loop, without waiting for the frame clock
+    step,      // the simulation steps of a frame
+    draw,      // drawing calls between beginpaint and endpaint
+    catch_up,  // the back buffer copying what changed from the frame published last
+    rasterize, // deferred draw commands run by endpaint
+    resolve,   // subpixels downsampled and cleared tiles filled by endpaint
+    publish,   // buffer swap and the frame sink
+    present,   // to_dc blitting the newest frame
+    wait,      // the frame clock sleeping until the next frame is due
+    paint,     // a WM_PAINT message on the window thread
+    worker,    // a pool thread running its share of a parallel loop
+    save,      // a frame written to an image file by the export queue
+    count,
+};
+
+namespace prof
+{
+
+inline const char *phase_name(Phase phase)
+{
+    static constexpr const char *names[] = {"frame",   "step",    "draw", "catch_up", "rasterize", "resolve",
+                                            "publish", "present", "wait", "paint",    "worker",    "save"};
+    return names[static_cast<int>(phase)];
+}
+
+// one timed scope, in nanoseconds since the profiler was first used
+struct sample
+{
+    Phase phase;
+    int thread; // threads are numbered in the order they record their first sample
+    uint64_t begin;
+    uint64_t duration;
+};
+
+inline uint64_t now()
+{
+    using clock = std::chrono::steady_clock;
+    static const clock::time_point epoch = clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - epoch).count();
+}
+
+/* the latest CAPACITY samples of one thread, written by that thread only and never blocking it
+ * a reader copies the slots below the head, then drops the ones the writer may have reused in the meantime
+ */
+class SampleRing
+{
+  public:
+    static constexpr uint64_t CAPACITY = 16384;
+
+  private:
+    static constexpr uint64_t DURATION_MASK = (uint64_t(1) << 56) - 1;
+
+    std::atomic<uint64_t> m_begin[CAPACITY];
+    std::atomic<uint64_t> m_info[CAPACITY]; // phase in the top byte, duration below
+    std::atomic<uint64_t> m_claimed{0};     // slots the writer started to fill
+    std::atomic<uint64_t> m_head{0};        // slots filled
+    std::atomic<uint64_t> m_floor{0};       // slots before it were dropped by reset
+    int m_thread;
+    std::string m_name; // guarded by the registry mutex
+
+  public:
+    SampleRing(int thread, std::string name) : m_thread(thread), m_name(std::move(name)) {}
+
+    int thread() const { return m_thread; }
+    const std::string &name() const { return m_name; }
+    void set_name(std::string name) { m_name = std::move(name); }
+
+    void push(Phase phase, uint64_t begin, uint64_t duration)
+    {
+        uint64_t h = m_head.load(std::memory_order_relaxed);
+        m_claimed.store(h + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_begin[h % CAPACITY].store(begin, std::memory_order_relaxed);
+        m_info[h % CAPACITY].store(uint64_t(phase) << 56 | std::min(duration, DURATION_MASK),
+                                   std::memory_order_relaxed);
+        m_head.store(h + 1, std::memory_order_release);
+    }
+
+    void collect(std::vector<sample> &out) const
+    {
+        uint64_t end = m_head.load(std::memory_order_acquire);
+        uint64_t first = std::max(m_floor.load(std::memory_order_relaxed), end > CAPACITY ? end - CAPACITY : 0);
+        std::size_t base = out.size();
+        for (uint64_t i = first; i < end; ++i)
+        {
+            uint64_t info = m_info[i % CAPACITY].load(std::memory_order_relaxed);
+            uint64_t begin = m_begin[i % CAPACITY].load(std::memory_order_relaxed);
+            out.push_back({static_cast<Phase>(info >> 56), m_thread, begin, info & DURATION_MASK});
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claimed = m_claimed.load(std::memory_order_relaxed);
+        uint64_t reused = claimed > CAPACITY ? claimed - CAPACITY : 0;
+        if (reused > first)
+            out.erase(out.begin() + base, out.begin() + base + std::min(reused, end) - first);
+    }
+
+    void reset() { m_floor.store(m_head.load(std::memory_order_acquire), std::memory_order_relaxed); }
+};
+
+struct registry
+{
+    std::atomic<bool> enabled{false};
+    std::mutex mtx;
+    std::vector<std::unique_ptr<SampleRing>> rings; // kept after their thread exits
+    bool summary = true;                             // report prints the percentiles
+    std::string summary_path;                        // empty for stderr
+    std::string trace_path;                          // report writes a trace when set
+};
+
+inline registry &state()
+{
+    static registry s_state;
+    return s_state;
+}
+
+struct local_thread
+{
+    SampleRing *ring = nullptr; // created by the first sample
+    std::string name;
+};
+
+inline local_thread &local()
+{
+    thread_local local_thread t;
+    return t;
+}
+
+inline SampleRing &local_ring()
+{
+    local_thread &t = local();
+    if (!t.ring)
+    {
+        registry &s = state();
+        std::lock_guard<std::mutex> lock(s.mtx);
+        s.rings.push_back(std::make_unique<SampleRing>(static_cast<int>(s.rings.size()), t.name));
+        t.ring = s.rings.back().get();
+    }
+    return *t.ring;
+}
+
+// the track name of the calling thread in traces, cheap enough to call when profiling is off
+inline void set_thread_name(const char *name)
+{
+    local_thread &t = local();
+    t.name = name;
+    if (t.ring)
+    {
+        std::lock_guard<std::mutex> lock(state().mtx);
+        t.ring->set_name(name);
+    }
+}
+
+inline void enable(bool on = true)
+{
+    now();
+    state().enabled.store(on, std::memory_order_relaxed);
+}
+
+inline bool enabled()
+{
+    return state().enabled.load(std::memory_order_relaxed);
+}
+
+inline void record(Phase phase, uint64_t begin, uint64_t end)
+{
+    local_ring().push(phase, begin, end - begin);
+}
+
+// the samples still held by every thread, oldest first within a thread
+inline std::vector<sample> samples()
+{
+    registry &s = state();
+    std::vector<sample> out;
+    std::lock_guard<std::mutex> lock(s.mtx);
+    for (const auto &ring : s.rings)
+    {
+        ring->collect(out);
+    }
+    return out;
+}
+
+// forget the samples recorded so far, for example after warming up
+inline void reset()
+{
+    registry &s = state();
+    std::lock_guard<std::mutex> lock(s.mtx);
+    for (const auto &ring : s.rings)
+    {
+        ring->reset();
+    }
+}
+
+// durations in microseconds
+struct phase_stats
+{
+    Phase phase;
+    std::size_t count;
+    double mean;
+    double p50;
+    double p99;
+    double max;
+};
+
+inline std::vector<phase_stats> summarize()
+{
+    std::vector<sample> all = samples();
+    std::vector<phase_stats> stats;
+    std::vector<uint64_t> d;
+    for (int p = 0; p < static_cast<int>(Phase::count); ++p)
+    {
+        d.clear();
+        for (const sample &s : all)
+        {
+            if (s.phase == static_cast<Phase>(p))
+                d.push_back(s.duration);
+        }
+        if (d.empty())
+            continue;
+        std::sort(d.begin(), d.end());
+        double sum = 0;
+        for (uint64_t v : d)
+        {
+            sum += v;
+        }
+        auto at = [&](double q) { return d[std::min(d.size() - 1, static_cast<std::size_t>(q * d.size()))] / 1e3; };
+        stats.push_back({static_cast<Phase>(p), d.size(), sum / d.size() / 1e3, at(0.5), at(0.99), d.back() / 1e3});
+    }
+    return stats;
+}
+
+inline void report(std::FILE *out)
+{
+    std::fprintf(out, "%-10s %8s %10s %10s %10s %10s\n", "phase (us)", "count", "mean", "p50", "p99", "max");
+    for (const phase_stats &s : summarize())
+    {
+        std::fprintf(out, "%-10s %8zu %10.1f %10.1f %10.1f %10.1f\n", phase_name(s.phase), s.count, s.mean, s.p50,
+                     s.p99, s.max);
+    }
+    std::fflush(out);
+}
+
+/* the samples as a Chrome trace, one track of complete events per thread, for chrome://tracing or ui.perfetto.dev
+ * returns false when the file could not be written
+ */
+inline bool write_trace(const char *path)
+{
+    std::vector<sample> all = samples();
+    std::vector<std::pair<int, std::string>> names;
+    {
+        registry &s = state();
+        std::lock_guard<std::mutex> lock(s.mtx);
+        for (const auto &ring : s.rings)
+        {
+            names.emplace_back(ring->thread(), ring->name());
+        }
+    }
+    std::sort(all.begin(), all.end(), [](const sample &a, const sample &b)
+              { return a.thread != b.thread ? a.thread < b.thread : a.begin < b.begin; });
+    std::FILE *out = std::fopen(path, "w");
+    if (!out)
+        return false;
+    std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    const char *sep = "";
+    for (const auto &[thread, name] : names)
+    {
+        if (name.empty())
+            continue;
+        std::fprintf(out, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"", sep,
+                     thread);
+        for (char c : name)
+        {
+            if (c == '"' || c == '\\')
+                std::fputc('\\', out);
+            if (static_cast<unsigned char>(c) >= 0x20)
+                std::fputc(c, out);
+        }
+        std::fprintf(out, "\"}}");
+        sep = ",\n";
+    }
+    // timestamps in microseconds with the nanoseconds as decimals
+    for (const sample &s : all)
+    {
+        std::fprintf(out, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"%s\",\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+                     sep, s.thread, phase_name(s.phase), static_cast<unsigned long long>(s.begin / 1000),
+                     static_cast<unsigned>(s.begin % 1000), static_cast<unsigned long long>(s.duration / 1000),
+                     static_cast<unsigned>(s.duration % 1000));
+        sep = ",\n";
+    }
+    std::fprintf(out, "\n]}\n");
+    return std::fclose(out) == 0;
+}
+
+// what enable_from_env asked for: the percentiles on stderr or in their file, and the trace
+inline void report()
+{
+    if (!enabled())
+        return;
+    registry &s = state();
+    if (s.summary)
+    {
+        std::FILE *out = s.summary_path.empty() ? stderr : std::fopen(s.summary_path.c_str(), "w");
+        if (out)
+        {
+            report(out);
+            if (out != stderr)
+                std::fclose(out);
+        }
+    }
+    if (!s.trace_path.empty())
+        write_trace(s.trace_path.c_str());
+}
+
+inline void report_at_exit()
+{
+    state();
+    std::atexit([] { report(); });
+}
+
+/* GAMES_PROFILE=1 reports percentiles on stderr, any other value except 0 names the file they go to
+ * GAMES_TRACE names the file a Chrome trace is written to, profiling is enabled when either is set
+ */
+inline bool enable_from_env()
+{
+    auto set = [](const char *env) { return env && *env && std::strcmp(env, "0") != 0; };
+    const char *profile = std::getenv("GAMES_PROFILE");
+    const char *trace = std::getenv("GAMES_TRACE");
+    if (!set(profile) && !set(trace))
+        return false;
+    registry &s = state();
+    s.summary = set(profile);
+    if (s.summary && std::strcmp(profile, "1") != 0)
+        s.summary_path = profile;
+    if (set(trace))
+        s.trace_path = trace;
+    enable();
+    return true;
+}
+
+} // end namespace prof
+
+// times the enclosing scope as one phase, while profiling is disabled it costs a relaxed load
+class ScopedTimer
+{
+  private:
+    Phase m_phase;
+    bool m_on;
+    uint64_t m_begin;
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  public:
+    explicit ScopedTimer(Phase phase) : m_phase(phase), m_on(prof::enabled()), m_begin(m_on ? prof::now() : 0) {}
+    ~ScopedTimer()
+    {
+        if (m_on)
+            prof::record(m_phase, m_begin, prof::now());
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_PROFILER_HPP
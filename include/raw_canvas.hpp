@@ -0,0 +1,411 @@
+#pragma once
+#ifndef GAMES_RAW_CANVAS_HPP
+#define GAMES_RAW_CANVAS_HPP
+
+#ifdef _WIN32
+#ifndef UNICODE
+#define UNICODE
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+#include "geometry2d.hpp"
+#include "lines.hpp"
+#include "profiler.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <span>
+#include <vector>
+
+namespace games
+{
+
+// the BMP file headers, laid out as BITMAPFILEHEADER and BITMAPINFOHEADER
+#pragma pack(push, 1)
+struct bmp_file_header
+{
+    uint16_t type;
+    uint32_t size;
+    uint16_t reserved1;
+    uint16_t reserved2;
+    uint32_t off_bits;
+};
+
+struct bmp_info_header
+{
+    uint32_t size;
+    int32_t width;
+    int32_t height; // negative for top-down rows
+    uint16_t planes;
+    uint16_t bit_count;
+    uint32_t compression;
+    uint32_t size_image;
+    int32_t x_pels_per_meter;
+    int32_t y_pels_per_meter;
+    uint32_t clr_used;
+    uint32_t clr_important;
+};
+#pragma pack(pop)
+static_assert(sizeof(bmp_file_header) == 14 && sizeof(bmp_info_header) == 40, "BMP headers must be packed");
+
+// BGRX rows written as a 24 bit bottom-up BMP, rows padded to 4 bytes, returns false when writing failed
+inline bool write_bmp(const char *fname, const uint8_t *pixels, std::ptrdiff_t stride, int width, int height)
+{
+    const int row = (3 * width + 3) & ~3;
+    bmp_info_header bih = {};
+    bih.size = sizeof(bmp_info_header);
+    bih.width = width;
+    bih.height = height;
+    bih.planes = 1;
+    bih.bit_count = 24;
+    bih.size_image = row * height;
+    bmp_file_header bfh;
+    bfh.type = 0x4d42;
+    bfh.size = sizeof(bmp_file_header) + sizeof(bmp_info_header) + bih.size_image;
+    bfh.reserved1 = 0;
+    bfh.reserved2 = 0;
+    bfh.off_bits = sizeof(bmp_file_header) + sizeof(bmp_info_header);
+    std::ofstream fp(fname, std::ios::binary);
+    fp.write(reinterpret_cast<const char *>(&bfh), sizeof(bmp_file_header));
+    fp.write(reinterpret_cast<const char *>(&bih), sizeof(bmp_info_header));
+    std::vector<uint8_t> line(row, 0);
+    for (int y = height - 1; y >= 0; --y)
+    {
+        simd::bgrx_to_bgr(pixels + y * stride, line.data(), width);
+        fp.write(reinterpret_cast<const char *>(line.data()), row);
+    }
+    return fp.good();
+}
+
+// a 24 bit uncompressed BMP such as write_bmp produces, as tightly packed BGRX rows, false when it is not one
+inline bool read_bmp(const char *fname, std::vector<uint8_t> &pixels, int &width, int &height)
+{
+    std::ifstream fp(fname, std::ios::binary);
+    bmp_file_header bfh;
+    bmp_info_header bih;
+    fp.read(reinterpret_cast<char *>(&bfh), sizeof(bmp_file_header));
+    fp.read(reinterpret_cast<char *>(&bih), sizeof(bmp_info_header));
+    if (!fp || bfh.type != 0x4d42 || bih.bit_count != 24 || bih.compression != 0 || bih.width <= 0 || bih.height == 0)
+        return false;
+    width = bih.width;
+    height = bih.height < 0 ? -bih.height : bih.height;
+    const int row = (3 * width + 3) & ~3;
+    std::vector<uint8_t> line(row);
+    pixels.assign(std::size_t(simd::PIXEL_BYTES) * width * height, 0);
+    fp.seekg(bfh.off_bits);
+    for (int i = 0; i < height; ++i)
+    {
+        if (!fp.read(reinterpret_cast<char *>(line.data()), row))
+            return false;
+        uint8_t *p = pixels.data() + std::size_t(simd::PIXEL_BYTES) * width * (bih.height < 0 ? i : height - 1 - i);
+        for (int x = 0; x < width; ++x, p += simd::PIXEL_BYTES)
+        {
+            p[0] = line[3 * x];
+            p[1] = line[3 * x + 1];
+            p[2] = line[3 * x + 2];
+        }
+    }
+    return true;
+}
+
+// pixels [x0, x1) x [y0, y1)
+struct pixel_region
+{
+    int x0, y0, x1, y1;
+};
+
+// a published frame, the pixels are valid for the duration of the call only
+struct frame_view
+{
+    const uint8_t *pixels; // BGRX rows
+    std::ptrdiff_t stride;
+    int width;
+    int height;
+    uint64_t index;                       // 1 for the first frame
+    std::span<const pixel_region> damage; // where it differs from the previous frame
+};
+
+// receives every frame published by a RawCanvas, on the producer thread
+class FrameSink
+{
+  public:
+    virtual ~FrameSink() = default;
+    virtual void write_frame(const frame_view &frame) = 0;
+};
+
+/* 32 bit BGRX pixels, rows padded to simd::ROW_ALIGN bytes
+ * on Windows the DIB is declared as wide as the padded row and blitted from its first width columns
+ * frames are triple buffered: the producer draws into the back buffer, endpaint swaps it with the ready one and
+ * to_dc swaps the ready one with the front when it holds a newer frame, so neither side waits or copies a frame
+ */
+class RawCanvas
+{
+  public:
+    using region = pixel_region;
+
+  private:
+    static constexpr int BUFFERS = 3;
+    static constexpr int FRESH = 4;           // set in m_ready while it holds a frame the presenter has not taken
+    static constexpr std::size_t HISTORY = 8; // frames of damage kept to bring an old back buffer up to date
+
+    bmp_info_header m_info;
+    uint8_t *m_buffers[BUFFERS];
+    uint8_t *m_pixels; // the back buffer
+    int m_width;
+    int m_height;
+    std::ptrdiff_t m_stride;
+
+    // producer side: the back buffer, the frame each buffer holds and the damage of the latest frames
+    int m_back = 0;
+    int m_last = 0; // the buffer published last
+    bool m_stale = false;
+    uint64_t m_frame = 0;
+    uint64_t m_version[BUFFERS] = {};
+    std::deque<std::vector<region>> m_history;
+    FrameSink *m_sink = nullptr;
+    // shared: the ready buffer, presenter side: the front buffer
+    std::atomic<int> m_ready{1};
+    int m_front = 2;
+
+    void copy_region(const uint8_t *src, const region &rc)
+    {
+        for (int y = rc.y0; y < rc.y1; ++y)
+        {
+            std::ptrdiff_t offset = y * m_stride + simd::PIXEL_BYTES * rc.x0;
+            std::memcpy(m_pixels + offset, src + offset, simd::PIXEL_BYTES * (rc.x1 - rc.x0));
+        }
+    }
+
+    // copy what changed since the back buffer was last drawn from the frame published last
+    void catch_up()
+    {
+        uint64_t behind = m_frame - m_version[m_back];
+        if (behind == 0)
+            return;
+        ScopedTimer timer(Phase::catch_up);
+        const uint8_t *src = m_buffers[m_last];
+        if (behind > m_history.size())
+            std::memcpy(m_pixels, src, m_stride * m_height);
+        else
+        {
+            for (auto it = m_history.end() - static_cast<std::ptrdiff_t>(behind); it != m_history.end(); ++it)
+            {
+                for (const region &rc : *it)
+                {
+                    copy_region(src, rc);
+                }
+            }
+        }
+        m_version[m_back] = m_frame;
+    }
+
+    // hand the back buffer to the presenter and take the ready one in exchange
+    void publish(std::vector<region> damage)
+    {
+        ScopedTimer timer(Phase::publish);
+        m_history.push_back(std::move(damage));
+        if (m_history.size() > HISTORY)
+            m_history.pop_front();
+        m_version[m_back] = ++m_frame;
+        m_last = m_back;
+        m_back = m_ready.exchange(m_back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+        m_pixels = m_buffers[m_back];
+        if (m_sink)
+            m_sink->write_frame({m_buffers[m_last], m_stride, m_width, m_height, m_frame, m_history.back()});
+    }
+
+  public:
+    RawCanvas(int width, int height) : m_width(width), m_height(height), m_stride(simd::row_stride(width))
+    {
+        m_info.size = sizeof(bmp_info_header);
+        m_info.width = static_cast<int32_t>(m_stride / simd::PIXEL_BYTES);
+        m_info.height = -height;
+        m_info.planes = 1;
+        m_info.bit_count = 32;
+        m_info.compression = 0; // BI_RGB
+        m_info.size_image = 0;
+        m_info.x_pels_per_meter = 0;
+        m_info.y_pels_per_meter = 0;
+        m_info.clr_used = 0;
+        m_info.clr_important = 0;
+        for (uint8_t *&buffer : m_buffers)
+        {
+            buffer = simd::alloc_rows(m_stride * height);
+        }
+        m_pixels = m_buffers[m_back];
+    }
+
+    ~RawCanvas()
+    {
+        for (uint8_t *buffer : m_buffers)
+        {
+            simd::free_rows(buffer);
+        }
+    }
+
+    uint8_t *raw_pixel(int x, int y) { return m_pixels + y * m_stride + simd::PIXEL_BYTES * x; }
+    const uint8_t *raw_pixel(int x, int y) const { return m_pixels + y * m_stride + simd::PIXEL_BYTES * x; }
+
+    void get_pixel(int x, int y, uint8_t &r, uint8_t &g, uint8_t &b) const
+    {
+        const uint8_t *p = raw_pixel(x, y);
+        b = p[0];
+        g = p[1];
+        r = p[2];
+    }
+
+    void set_pixel(int x, int y, uint8_t r, uint8_t g, uint8_t b)
+    {
+        uint8_t *p = raw_pixel(x, y);
+        p[0] = b;
+        p[1] = g;
+        p[2] = r;
+    }
+
+    // blend a premultiplied color into [x0, x1) x [y0, y1)
+    void blend_rect(int x0, int y0, int x1, int y1, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        const uint8_t bgrx[4] = {color.b, color.g, color.r, 0};
+        for (int y = y0; y < y1 && x0 < x1; ++y)
+        {
+            simd::blend_span(raw_pixel(x0, y), x1 - x0, bgrx, color.a, mode);
+        }
+    }
+
+    void blend_pixel(int x, int y, rgba color, BlendMode mode = BlendMode::src_over)
+    {
+        blend_rect(x, y, x + 1, y + 1, color, mode);
+    }
+
+    // mix an opaque color into a pixel by alpha in 0..255
+    void mix_pixel(int x, int y, rgb color, int alpha)
+    {
+        uint8_t *p = raw_pixel(x, y);
+        const uint8_t bgr[3] = {color.b, color.g, color.r};
+        for (int k = 0; k < 3; ++k)
+        {
+            p[k] = static_cast<uint8_t>((p[k] * (255 - alpha) + bgr[k] * alpha + 127) / 255);
+        }
+    }
+
+    // 1 pixel wide line clipped to the canvas, Wu anti-aliased or aliased subpixel Bresenham
+    void draw_line(const geo2d::line &l, rgb color, bool antialias = true)
+    {
+        lines::bounds clip = {0, 0, m_width, m_height};
+        if (antialias)
+        {
+            lines::wu(l.start[0], l.start[1], l.stop[0], l.stop[1], clip,
+                      [&](int x, int y, int alpha) { mix_pixel(x, y, color, alpha); });
+            return;
+        }
+        lines::dda(l.start[0], l.start[1], l.stop[0], l.stop[1], 1, clip,
+                   [&](bool steep, int major, int minor, int)
+                   {
+                       if (steep)
+                           set_pixel(minor, major, color.r, color.g, color.b);
+                       else
+                           set_pixel(major, minor, color.r, color.g, color.b);
+                   });
+    }
+
+    void draw_lines(std::span<const geo2d::line> segments, rgb color, bool antialias = true)
+    {
+        for (const geo2d::line &l : segments)
+        {
+            draw_line(l, color, antialias);
+        }
+    }
+
+    void fill(uint8_t r, uint8_t g, uint8_t b) { fill_rect(0, 0, m_width, m_height, r, g, b); }
+
+    void fill_rect(int x0, int y0, int x1, int y1, uint8_t r, uint8_t g, uint8_t b)
+    {
+        const uint8_t bgrx[4] = {b, g, r, 0};
+        simd::fill_rect(raw_pixel(x0, y0), m_stride, x1 - x0, y1 - y0, bgrx);
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    std::ptrdiff_t stride() const { return m_stride; }
+    // every frame published from now on is also written to sink, nullptr detaches it
+    void set_sink(FrameSink *sink) { m_sink = sink; }
+    // the frame being drawn, between an endpaint and the next beginpaint the frame just published
+    void save_bmp(const char *fname) const
+    {
+        const uint8_t *pixels = m_stale ? m_buffers[m_last] : m_pixels;
+        write_bmp(fname, pixels, m_stride, m_width, m_height);
+    }
+
+    // the frame published last, untouched until the next endpaint, empty before the first one
+    frame_view last_frame() const
+    {
+        std::span<const region> damage;
+        if (!m_history.empty())
+            damage = m_history.back();
+        return {m_buffers[m_last], m_stride, m_width, m_height, m_frame, damage};
+    }
+
+    /* start drawing a frame into the back buffer, which first catches up with the frame published last
+     * pass redraw_all when every pixel is going to be painted again to skip that copy
+     */
+    void beginpaint(bool redraw_all = false)
+    {
+        if (m_stale && !redraw_all)
+            catch_up();
+        m_stale = false;
+    }
+
+    // publish a frame in which everything may have changed, the back buffer catches up in beginpaint
+    void endpaint()
+    {
+        publish({region{0, 0, m_width, m_height}});
+        m_stale = true;
+    }
+
+    // publish a frame in which only the damaged regions changed, the back buffer catches up in beginpaint too
+    void endpaint(const std::vector<region> &damage)
+    {
+        publish(damage);
+        m_stale = true;
+    }
+
+    /* the newest published frame, stride() bytes per row, called from a single presenter thread
+     * the pixels stay untouched by the producer until the next call
+     */
+    const uint8_t *present()
+    {
+        if (m_ready.load(std::memory_order_relaxed) & FRESH)
+            m_front = m_ready.exchange(m_front, std::memory_order_acq_rel) & ~FRESH;
+        return m_buffers[m_front];
+    }
+
+#ifdef _WIN32
+    void to_dc(HDC hdc, int width, int height)
+    {
+        ScopedTimer timer(Phase::present);
+        const uint8_t *pixels = present();
+        BITMAPINFO bmi = {};
+        std::memcpy(&bmi.bmiHeader, &m_info, sizeof(bmp_info_header));
+        if (width == m_width && height == m_height)
+        {
+            ::SetDIBitsToDevice(hdc, 0, 0, width, height, 0, 0, 0, m_height, pixels, &bmi, DIB_RGB_COLORS);
+        }
+        else
+        {
+            ::StretchDIBits(hdc, 0, 0, width, height, 0, 0, m_width, m_height, pixels, &bmi, DIB_RGB_COLORS,
+                            SRCCOPY);
+        }
+    }
+#endif
+};
+
+} // end namespace games
+
+#endif // GAMES_RAW_CANVAS_HPP
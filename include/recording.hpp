@@ -0,0 +1,525 @@
+#pragma once
+#ifndef GAMES_RECORDING_HPP
+#define GAMES_RECORDING_HPP
+
+#include "raw_canvas.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace games
+{
+
+/* delta frame recordings, every integer little endian
+ *   header   "GREC", u32 version, u32 width, u32 height, u32 tile size
+ *   frame    u8 kind, u32 payload bytes, payload
+ *            key: the frame as packed BGR pixels, run length coded
+ *            delta: u32 tile count, then per changed tile u32 tile index, u32 bytes, the tile XOR the previous
+ *            frame as packed BGR pixels in row order, run length coded
+ *   index    u64 offset and u8 kind per frame
+ *   trailer  u64 index offset, u32 frame count, "GIDX"
+ * a recording that was not closed has no index, the replayer then rebuilds it by walking the frames
+ */
+namespace rec
+{
+
+inline constexpr char MAGIC[4] = {'G', 'R', 'E', 'C'};
+inline constexpr char INDEX_MAGIC[4] = {'G', 'I', 'D', 'X'};
+inline constexpr uint32_t VERSION = 1;
+inline constexpr int HEADER_BYTES = 20;
+inline constexpr int FRAME_HEADER_BYTES = 5;
+inline constexpr int TRAILER_BYTES = 16;
+
+enum kind : uint8_t
+{
+    key = 0,
+    delta = 1,
+};
+
+inline void put_u32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+}
+
+// overwrite a u32 reserved earlier at pos
+inline void patch_u32(std::vector<uint8_t> &out, std::size_t pos, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out[pos + i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+inline void put_u64(std::vector<uint8_t> &out, uint64_t v)
+{
+    put_u32(out, static_cast<uint32_t>(v));
+    put_u32(out, static_cast<uint32_t>(v >> 32));
+}
+
+inline uint32_t get_u32(const uint8_t *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+inline uint64_t get_u64(const uint8_t *p) { return get_u32(p) | uint64_t(get_u32(p + 4)) << 32; }
+
+inline void put_varint(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (; v >= 0x80; v >>= 7)
+    {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+inline bool get_varint(const uint8_t *&in, const uint8_t *end, uint32_t &v)
+{
+    v = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7)
+    {
+        uint8_t b = *in++;
+        v |= uint32_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* n packed BGR pixels as tokens, a varint c followed by
+ * one pixel repeated (c >> 1) + 1 times when c is odd, or (c >> 1) + 1 literal pixels when c is even
+ * XOR deltas are long zero runs and flat backgrounds long runs of one color, both shrink to a few bytes
+ */
+inline void rle_encode(const uint8_t *px, int n, std::vector<uint8_t> &out)
+{
+    auto same = [px](int a, int b) { return std::memcmp(px + 3 * a, px + 3 * b, 3) == 0; };
+    int i = 0;
+    while (i < n)
+    {
+        int j = i + 1;
+        while (j < n && same(i, j))
+        {
+            ++j;
+        }
+        if (j - i >= 2)
+        {
+            put_varint(out, uint32_t(j - i - 1) << 1 | 1);
+            out.insert(out.end(), px + 3 * i, px + 3 * i + 3);
+            i = j;
+            continue;
+        }
+        // literal until the next pair of equal pixels
+        j = i + 1;
+        while (j < n && !(j + 1 < n && same(j, j + 1)))
+        {
+            ++j;
+        }
+        put_varint(out, uint32_t(j - i - 1) << 1);
+        out.insert(out.end(), px + 3 * i, px + 3 * j);
+        i = j;
+    }
+}
+
+inline bool rle_decode(const uint8_t *&in, const uint8_t *end, uint8_t *px, int n)
+{
+    int i = 0;
+    while (i < n)
+    {
+        uint32_t c;
+        if (!get_varint(in, end, c))
+            return false;
+        int count = int(c >> 1) + 1;
+        int bytes = c & 1 ? 3 : 3 * count;
+        if (count > n - i || end - in < bytes)
+            return false;
+        if (c & 1)
+        {
+            for (int k = 0; k < count; ++k)
+            {
+                std::memcpy(px + 3 * (i + k), in, 3);
+            }
+        }
+        else
+            std::memcpy(px + 3 * i, in, bytes);
+        in += bytes;
+        i += count;
+    }
+    return true;
+}
+
+inline bool seek(std::FILE *file, uint64_t offset)
+{
+#ifdef _WIN32
+    return ::_fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+    return ::fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+inline uint64_t tell(std::FILE *file)
+{
+#ifdef _WIN32
+    return static_cast<uint64_t>(::_ftelli64(file));
+#else
+    return static_cast<uint64_t>(::ftello(file));
+#endif
+}
+
+} // end namespace rec
+
+// records every published frame of a RawCanvas, a key frame every key_interval frames and tile deltas in between
+class FrameRecorder : public FrameSink
+{
+  private:
+    std::FILE *m_file;
+    int m_key_interval;
+    int m_tile;
+    int m_width = 0;
+    int m_height = 0;
+    uint64_t m_offset = 0;
+    bool m_ok;
+    std::vector<uint8_t> m_prev; // the previous frame as packed BGR
+    std::vector<uint8_t> m_tile_px;
+    std::vector<uint8_t> m_candidate; // tiles touched by the damage of the current frame
+    std::vector<uint8_t> m_out;
+    std::vector<uint8_t> m_index;
+    uint32_t m_frames = 0;
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    bool write(const std::vector<uint8_t> &bytes)
+    {
+        m_ok = m_ok && std::fwrite(bytes.data(), 1, bytes.size(), m_file) == bytes.size();
+        m_offset += bytes.size();
+        return m_ok;
+    }
+
+    void start(int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        m_prev.assign(3 * std::size_t(width) * height, 0);
+        m_tile_px.resize(3 * m_tile * m_tile);
+        m_out.assign(rec::MAGIC, rec::MAGIC + 4);
+        rec::put_u32(m_out, rec::VERSION);
+        rec::put_u32(m_out, width);
+        rec::put_u32(m_out, height);
+        rec::put_u32(m_out, m_tile);
+        write(m_out);
+    }
+
+    void encode_key(const frame_view &f)
+    {
+        for (int y = 0; y < f.height; ++y)
+        {
+            simd::bgrx_to_bgr(f.pixels + y * f.stride, m_prev.data() + 3 * y * f.width, f.width);
+        }
+        rec::rle_encode(m_prev.data(), f.width * f.height, m_out);
+    }
+
+    // tiles touched by the damage whose pixels really changed, m_prev is updated along the way
+    void encode_delta(const frame_view &f)
+    {
+        const int tiles_x = (f.width + m_tile - 1) / m_tile;
+        const int tiles_y = (f.height + m_tile - 1) / m_tile;
+        m_candidate.assign(tiles_x * tiles_y, 0);
+        for (const pixel_region &rc : f.damage)
+        {
+            int x1 = std::min(rc.x1, f.width);
+            int y1 = std::min(rc.y1, f.height);
+            for (int ty = std::max(rc.y0, 0) / m_tile; ty * m_tile < y1; ++ty)
+            {
+                for (int tx = std::max(rc.x0, 0) / m_tile; tx * m_tile < x1; ++tx)
+                {
+                    m_candidate[ty * tiles_x + tx] = 1;
+                }
+            }
+        }
+        std::size_t count_at = m_out.size();
+        rec::put_u32(m_out, 0);
+        uint32_t count = 0;
+        uint8_t bgr[3];
+        for (int t = 0; t < tiles_x * tiles_y; ++t)
+        {
+            if (!m_candidate[t])
+                continue;
+            int x0 = t % tiles_x * m_tile;
+            int y0 = t / tiles_x * m_tile;
+            int w = std::min(m_tile, f.width - x0);
+            int h = std::min(m_tile, f.height - y0);
+            bool changed = false;
+            uint8_t *d = m_tile_px.data();
+            for (int y = y0; y < y0 + h; ++y)
+            {
+                const uint8_t *src = f.pixels + y * f.stride + simd::PIXEL_BYTES * x0;
+                uint8_t *prev = m_prev.data() + 3 * (std::size_t(y) * f.width + x0);
+                for (int x = 0; x < w; ++x, src += simd::PIXEL_BYTES, prev += 3, d += 3)
+                {
+                    std::memcpy(bgr, src, 3);
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        d[k] = bgr[k] ^ prev[k];
+                        changed |= d[k] != 0;
+                        prev[k] = bgr[k];
+                    }
+                }
+            }
+            if (!changed)
+                continue;
+            rec::put_u32(m_out, t);
+            std::size_t size_at = m_out.size();
+            rec::put_u32(m_out, 0);
+            rec::rle_encode(m_tile_px.data(), w * h, m_out);
+            rec::patch_u32(m_out, size_at, static_cast<uint32_t>(m_out.size() - size_at - 4));
+            ++count;
+        }
+        rec::patch_u32(m_out, count_at, count);
+    }
+
+  public:
+    // key_interval bounds how many deltas a seek has to decode, tile is the delta granularity in pixels
+    explicit FrameRecorder(const char *path, int key_interval = 120, int tile = 32)
+        : m_file(std::fopen(path, "wb")), m_key_interval(std::max(key_interval, 1)), m_tile(std::max(tile, 1)),
+          m_ok(m_file != nullptr)
+    {}
+
+    ~FrameRecorder() { close(); }
+
+    // false once opening or a write failed, later frames are dropped, after close whether the file is complete
+    bool ok() const { return m_ok; }
+    uint32_t frames() const { return m_frames; }
+    uint64_t bytes() const { return m_offset; }
+
+    void write_frame(const frame_view &frame) override
+    {
+        if (!m_ok || !m_file)
+            return;
+        if (m_width == 0)
+            start(frame.width, frame.height);
+        if (frame.width != m_width || frame.height != m_height)
+        {
+            m_ok = false;
+            return;
+        }
+        rec::kind kind = m_frames % m_key_interval == 0 ? rec::key : rec::delta;
+        rec::put_u64(m_index, m_offset);
+        m_index.push_back(kind);
+        m_out.assign(1, kind);
+        rec::put_u32(m_out, 0);
+        if (kind == rec::key)
+            encode_key(frame);
+        else
+            encode_delta(frame);
+        rec::patch_u32(m_out, 1, static_cast<uint32_t>(m_out.size() - rec::FRAME_HEADER_BYTES));
+        if (write(m_out))
+            ++m_frames;
+    }
+
+    // write the index and close the file, later frames are dropped
+    void close()
+    {
+        if (!m_file)
+            return;
+        if (m_ok && m_width > 0)
+        {
+            uint64_t index_offset = m_offset;
+            write(m_index);
+            m_out.clear();
+            rec::put_u64(m_out, index_offset);
+            rec::put_u32(m_out, m_frames);
+            m_out.insert(m_out.end(), rec::INDEX_MAGIC, rec::INDEX_MAGIC + 4);
+            write(m_out);
+        }
+        m_ok = std::fclose(m_file) == 0 && m_ok;
+        m_file = nullptr;
+    }
+};
+
+// random access into a recording, frames are decoded forward from the closest key frame
+class FrameReplayer
+{
+  private:
+    struct entry
+    {
+        uint64_t offset;
+        uint8_t kind;
+    };
+
+    std::FILE *m_file;
+    int m_width = 0;
+    int m_height = 0;
+    int m_tile = 0;
+    std::vector<entry> m_index;
+    std::vector<uint8_t> m_frame; // the decoded frame m_current as packed BGR
+    std::vector<uint8_t> m_tile_px;
+    std::vector<uint8_t> m_payload;
+    int m_current = -1;
+
+    FrameReplayer(const FrameReplayer &) = delete;
+    FrameReplayer &operator=(const FrameReplayer &) = delete;
+
+    bool read_at(uint64_t offset, uint8_t *dst, std::size_t n)
+    {
+        return rec::seek(m_file, offset) && std::fread(dst, 1, n, m_file) == n;
+    }
+
+    bool load_index()
+    {
+        if (std::fseek(m_file, 0, SEEK_END) != 0)
+            return false;
+        const uint64_t size = rec::tell(m_file);
+        uint8_t trailer[rec::TRAILER_BYTES];
+        bool indexed = size >= rec::HEADER_BYTES + rec::TRAILER_BYTES &&
+                       read_at(size - rec::TRAILER_BYTES, trailer, sizeof(trailer)) &&
+                       std::memcmp(trailer + 12, rec::INDEX_MAGIC, 4) == 0;
+        if (indexed)
+        {
+            uint64_t index_offset = rec::get_u64(trailer);
+            uint32_t frames = rec::get_u32(trailer + 8);
+            std::vector<uint8_t> index(9 * std::size_t(frames));
+            if (index_offset + index.size() + rec::TRAILER_BYTES == size &&
+                read_at(index_offset, index.data(), index.size()))
+            {
+                for (uint32_t i = 0; i < frames; ++i)
+                {
+                    m_index.push_back({rec::get_u64(&index[9 * i]), index[9 * i + 8]});
+                }
+                return true;
+            }
+        }
+        // no index, walk the frame headers up to the first incomplete frame
+        uint64_t offset = rec::HEADER_BYTES;
+        uint8_t head[rec::FRAME_HEADER_BYTES];
+        while (offset + rec::FRAME_HEADER_BYTES <= size && read_at(offset, head, sizeof(head)))
+        {
+            uint64_t next = offset + rec::FRAME_HEADER_BYTES + rec::get_u32(head + 1);
+            if (head[0] > rec::delta || next > size)
+                break;
+            m_index.push_back({offset, head[0]});
+            offset = next;
+        }
+        return true;
+    }
+
+    bool apply(int index)
+    {
+        const entry &e = m_index[index];
+        uint8_t head[rec::FRAME_HEADER_BYTES];
+        if (!read_at(e.offset, head, sizeof(head)))
+            return false;
+        m_payload.resize(rec::get_u32(head + 1));
+        if (std::fread(m_payload.data(), 1, m_payload.size(), m_file) != m_payload.size())
+            return false;
+        const uint8_t *in = m_payload.data();
+        const uint8_t *end = in + m_payload.size();
+        if (head[0] == rec::key)
+            return rec::rle_decode(in, end, m_frame.data(), m_width * m_height);
+        const int tiles_x = (m_width + m_tile - 1) / m_tile;
+        const int tiles_y = (m_height + m_tile - 1) / m_tile;
+        if (end - in < 4)
+            return false;
+        uint32_t count = rec::get_u32(in);
+        in += 4;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (end - in < 8)
+                return false;
+            uint32_t t = rec::get_u32(in);
+            uint32_t bytes = rec::get_u32(in + 4);
+            in += 8;
+            if (t >= uint32_t(tiles_x * tiles_y) || uint64_t(end - in) < bytes)
+                return false;
+            int x0 = t % tiles_x * m_tile;
+            int y0 = t / tiles_x * m_tile;
+            int w = std::min(m_tile, m_width - x0);
+            int h = std::min(m_tile, m_height - y0);
+            const uint8_t *tile_end = in + bytes;
+            if (!rec::rle_decode(in, tile_end, m_tile_px.data(), w * h))
+                return false;
+            in = tile_end;
+            const uint8_t *d = m_tile_px.data();
+            for (int y = y0; y < y0 + h; ++y)
+            {
+                uint8_t *px = m_frame.data() + 3 * (std::size_t(y) * m_width + x0);
+                for (int k = 0; k < 3 * w; ++k)
+                {
+                    px[k] ^= *d++;
+                }
+            }
+        }
+        return true;
+    }
+
+  public:
+    explicit FrameReplayer(const char *path) : m_file(std::fopen(path, "rb"))
+    {
+        uint8_t header[rec::HEADER_BYTES];
+        if (m_file && std::fread(header, 1, sizeof(header), m_file) == sizeof(header) &&
+            std::memcmp(header, rec::MAGIC, 4) == 0 && rec::get_u32(header + 4) == rec::VERSION)
+        {
+            m_width = static_cast<int>(rec::get_u32(header + 8));
+            m_height = static_cast<int>(rec::get_u32(header + 12));
+            m_tile = static_cast<int>(rec::get_u32(header + 16));
+            if (m_width > 0 && m_height > 0 && m_tile > 0 && load_index())
+            {
+                m_frame.resize(3 * std::size_t(m_width) * m_height);
+                m_tile_px.resize(3 * std::size_t(m_tile) * m_tile);
+                return;
+            }
+        }
+        m_width = m_height = 0;
+        m_index.clear();
+    }
+
+    ~FrameReplayer()
+    {
+        if (m_file)
+            std::fclose(m_file);
+    }
+
+    bool ok() const { return m_width > 0; }
+    int frames() const { return static_cast<int>(m_index.size()); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // decode frame index into the back buffer of canvas, which must have the recorded size
+    bool read_frame(int index, RawCanvas &canvas)
+    {
+        if (index < 0 || index >= frames() || canvas.width() != m_width || canvas.height() != m_height)
+            return false;
+        int key = index;
+        while (key > 0 && m_index[key].kind != rec::key)
+        {
+            --key;
+        }
+        int from = m_current >= key && m_current <= index ? m_current + 1 : key;
+        for (int i = from; i <= index; ++i)
+        {
+            if (!apply(i))
+            {
+                m_current = -1;
+                return false;
+            }
+            m_current = i;
+        }
+        for (int y = 0; y < m_height; ++y)
+        {
+            const uint8_t *src = m_frame.data() + 3 * std::size_t(y) * m_width;
+            uint8_t *dst = canvas.raw_pixel(0, y);
+            for (int x = 0; x < m_width; ++x, src += 3, dst += simd::PIXEL_BYTES)
+            {
+                std::memcpy(dst, src, 3);
+            }
+        }
+        return true;
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_RECORDING_HPP
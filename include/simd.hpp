@@ -0,0 +1,599 @@
+#pragma once
+#ifndef GAMES_SIMD_HPP
+#define GAMES_SIMD_HPP
+
+#include "color.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GAMES_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GAMES_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GAMES_TARGET_AVX2
+#endif
+
+namespace games
+{
+
+namespace simd
+{
+
+enum class isa
+{
+    scalar,
+    sse2,
+    avx2,
+};
+
+inline isa detect()
+{
+#if defined(GAMES_SIMD_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int nids = info[0];
+    __cpuid(info, 1);
+    bool sse2 = info[3] & (1 << 26);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx = info[2] & (1 << 28);
+    bool avx2 = false;
+    if (nids >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = info[1] & (1 << 5);
+    }
+    return avx2 ? isa::avx2 : sse2 ? isa::sse2 : isa::scalar;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return isa::avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return isa::sse2;
+    return isa::scalar;
+#endif
+#else
+    return isa::scalar;
+#endif
+}
+
+// the instruction set used by the dispatched kernels, detected once
+inline isa &active_isa()
+{
+    static isa s_isa = detect();
+    return s_isa;
+}
+
+/* pixels are 4 bytes BGRX, the padding byte is kept 0
+ * rows start on ROW_ALIGN bytes so vector stores of whole rows stay aligned
+ */
+inline constexpr int PIXEL_BYTES = 4;
+inline constexpr std::size_t ROW_ALIGN = 64;
+
+// bytes per row of w pixels, padded to ROW_ALIGN
+inline constexpr std::ptrdiff_t row_stride(int w)
+{
+    return (PIXEL_BYTES * std::ptrdiff_t(w) + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN;
+}
+
+// zeroed storage aligned to ROW_ALIGN, release with free_rows
+inline uint8_t *alloc_rows(std::size_t bytes)
+{
+    auto p = static_cast<uint8_t *>(::operator new[](bytes, std::align_val_t(ROW_ALIGN)));
+    std::memset(p, 0, bytes);
+    return p;
+}
+
+inline void free_rows(uint8_t *p)
+{
+    ::operator delete[](p, std::align_val_t(ROW_ALIGN));
+}
+
+// sum[i] += row[i] for i < n
+inline void accumulate_row_scalar(uint16_t *sum, const uint8_t *row, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        sum[i] += row[i];
+    }
+}
+
+#if defined(GAMES_SIMD_X86)
+inline void accumulate_row_sse2(uint16_t *sum, const uint8_t *row, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        __m128i *s = reinterpret_cast<__m128i *>(sum + i);
+        _mm_storeu_si128(s, _mm_add_epi16(_mm_loadu_si128(s), _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128(s + 1, _mm_add_epi16(_mm_loadu_si128(s + 1), _mm_unpackhi_epi8(v, zero)));
+    }
+    accumulate_row_scalar(sum + i, row + i, n - i);
+}
+
+GAMES_TARGET_AVX2 inline void accumulate_row_avx2(uint16_t *sum, const uint8_t *row, int n)
+{
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i + 16)));
+        __m256i *s = reinterpret_cast<__m256i *>(sum + i);
+        _mm256_storeu_si256(s, _mm256_add_epi16(_mm256_loadu_si256(s), lo));
+        _mm256_storeu_si256(s + 1, _mm256_add_epi16(_mm256_loadu_si256(s + 1), hi));
+    }
+    accumulate_row_sse2(sum + i, row + i, n - i);
+}
+#endif
+
+// sum[i] += sum[i + step] for i < n, sum must be readable up to n + step
+inline void fold_scalar(uint16_t *sum, int n, int step)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        sum[i] += sum[i + step];
+    }
+}
+
+#if defined(GAMES_SIMD_X86)
+inline void fold_sse2(uint16_t *sum, int n, int step)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i *s = reinterpret_cast<__m128i *>(sum + i);
+        __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + i + step));
+        _mm_storeu_si128(s, _mm_add_epi16(_mm_loadu_si128(s), t));
+    }
+    fold_scalar(sum + i, n - i, step);
+}
+
+GAMES_TARGET_AVX2 inline void fold_avx2(uint16_t *sum, int n, int step)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i *s = reinterpret_cast<__m256i *>(sum + i);
+        __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sum + i + step));
+        _mm256_storeu_si256(s, _mm256_add_epi16(_mm256_loadu_si256(s), t));
+    }
+    fold_sse2(sum + i, n - i, step);
+}
+#endif
+
+inline void accumulate_row(uint16_t *sum, const uint8_t *row, int n)
+{
+#if defined(GAMES_SIMD_X86)
+    switch (active_isa())
+    {
+        case isa::avx2: return accumulate_row_avx2(sum, row, n);
+        case isa::sse2: return accumulate_row_sse2(sum, row, n);
+        default: break;
+    }
+#endif
+    accumulate_row_scalar(sum, row, n);
+}
+
+inline void fold(uint16_t *sum, int n, int step)
+{
+#if defined(GAMES_SIMD_X86)
+    switch (active_isa())
+    {
+        case isa::avx2: return fold_avx2(sum, n, step);
+        case isa::sse2: return fold_sse2(sum, n, step);
+        default: break;
+    }
+#endif
+    fold_scalar(sum, n, step);
+}
+
+// scratch size (in uint16_t) needed by box_downsample for a row of w output pixels
+template <int SN>
+constexpr std::size_t box_downsample_scratch(int w)
+{
+    return PIXEL_BYTES * SN * (w + 1) + 32;
+}
+
+/* SN x SN box filter from BGRX subpixels to BGRX pixels, rounding half up
+ * src points to the top left subpixel, dst to the top left pixel, both strides in bytes
+ * each output row sums SN subpixel rows vertically, then folds neighbouring subpixels with shifted adds
+ */
+template <int SN>
+void box_downsample(const uint8_t *src, std::ptrdiff_t src_stride, uint8_t *dst, std::ptrdiff_t dst_stride, int w,
+                    int h, uint16_t *scratch)
+{
+    static_assert(SN * SN * 255 <= 0xffff, "16 bit accumulators overflow");
+    constexpr int shift = SN == 1 ? 0 : SN == 2 ? 2 : SN == 4 ? 4 : 6;
+    static_assert((1 << shift) == SN * SN, "SN must be a power of 2 up to 8");
+    const int n = PIXEL_BYTES * SN * w;
+    for (int y = 0; y < h; ++y)
+    {
+        std::fill(scratch, scratch + box_downsample_scratch<SN>(w), uint16_t(0));
+        for (int sy = 0; sy < SN; ++sy)
+        {
+            accumulate_row(scratch, src + (y * SN + sy) * src_stride, n);
+        }
+        for (int step = PIXEL_BYTES; step < PIXEL_BYTES * SN; step *= 2)
+        {
+            fold(scratch, n, step);
+        }
+        uint8_t *out = dst + y * dst_stride;
+        for (int x = 0; x < w; ++x)
+        {
+            const uint16_t *s = scratch + PIXEL_BYTES * SN * x;
+            uint8_t px[PIXEL_BYTES];
+            for (int k = 0; k < PIXEL_BYTES; ++k)
+            {
+                px[k] = static_cast<uint8_t>((s[k] + SN * SN / 2) >> shift);
+            }
+            std::memcpy(out + PIXEL_BYTES * x, px, PIXEL_BYTES);
+        }
+    }
+}
+
+/* covered samples [begin, end) of one row of a convex shape given by edge functions
+ * sample i in [0, n) is covered when e[k] + i * a[k] >= 0 for k < 3, covered samples must be contiguous
+ */
+inline void edge_span_scalar(const int64_t *e, const int64_t *a, int n, int &begin, int &end)
+{
+    auto inside = [&](int i) { return e[0] + i * a[0] >= 0 && e[1] + i * a[1] >= 0 && e[2] + i * a[2] >= 0; };
+    int i = 0;
+    while (i < n && !inside(i))
+    {
+        ++i;
+    }
+    begin = i;
+    while (i < n && inside(i))
+    {
+        ++i;
+    }
+    end = i;
+}
+
+// the vector kernels evaluate blocks of samples in 32 bit lanes, block origins are clamped to this range
+inline constexpr int64_t edge_clamp = int64_t(1) << 30;
+inline constexpr int64_t edge_step_max = int64_t(1) << 26;
+
+// scan a block of W lanes whose covered mask is covered, returns true when the span is complete
+template <int W>
+inline bool edge_span_block(unsigned covered, int i, int n, int &begin, int &end)
+{
+    unsigned valid = n - i >= W ? (1u << W) - 1 : (1u << (n - i)) - 1;
+    covered &= valid;
+    if (begin < 0)
+    {
+        if (!covered)
+            return false;
+        begin = i + std::countr_zero(covered);
+        covered |= (1u << (begin - i)) - 1; // lanes before begin do not end the span
+    }
+    unsigned outside = ~covered & valid;
+    if (!outside)
+        return false;
+    end = i + std::countr_zero(outside);
+    return true;
+}
+
+#if defined(GAMES_SIMD_X86)
+inline void edge_span_sse2(const int64_t *e, const int64_t *a, int n, int &begin, int &end)
+{
+    __m128i step[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        int32_t ak = static_cast<int32_t>(a[k]);
+        step[k] = _mm_setr_epi32(0, ak, 2 * ak, 3 * ak);
+    }
+    begin = -1;
+    for (int i = 0; i < n; i += 4)
+    {
+        __m128i m = _mm_setzero_si128();
+        for (int k = 0; k < 3; ++k)
+        {
+            int64_t base = std::clamp(e[k] + i * a[k], -edge_clamp, edge_clamp);
+            m = _mm_or_si128(m, _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(base)), step[k]));
+        }
+        unsigned covered = ~_mm_movemask_ps(_mm_castsi128_ps(m)) & 0xf;
+        if (edge_span_block<4>(covered, i, n, begin, end))
+            return;
+    }
+    if (begin < 0)
+        begin = n;
+    end = n;
+}
+
+GAMES_TARGET_AVX2 inline void edge_span_avx2(const int64_t *e, const int64_t *a, int n, int &begin, int &end)
+{
+    __m256i step[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        int32_t ak = static_cast<int32_t>(a[k]);
+        step[k] = _mm256_mullo_epi32(_mm256_set1_epi32(ak), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+    begin = -1;
+    for (int i = 0; i < n; i += 8)
+    {
+        __m256i m = _mm256_setzero_si256();
+        for (int k = 0; k < 3; ++k)
+        {
+            int64_t base = std::clamp(e[k] + i * a[k], -edge_clamp, edge_clamp);
+            m = _mm256_or_si256(m, _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(base)), step[k]));
+        }
+        unsigned covered = ~_mm256_movemask_ps(_mm256_castsi256_ps(m)) & 0xff;
+        if (edge_span_block<8>(covered, i, n, begin, end))
+            return;
+    }
+    if (begin < 0)
+        begin = n;
+    end = n;
+}
+#endif
+
+inline void edge_span(const int64_t *e, const int64_t *a, int n, int &begin, int &end)
+{
+#if defined(GAMES_SIMD_X86)
+    bool fits = std::abs(a[0]) < edge_step_max && std::abs(a[1]) < edge_step_max && std::abs(a[2]) < edge_step_max;
+    switch (fits ? active_isa() : isa::scalar)
+    {
+        case isa::avx2: return edge_span_avx2(e, a, n, begin, end);
+        case isa::sse2: return edge_span_sse2(e, a, n, begin, end);
+        default: break;
+    }
+#endif
+    edge_span_scalar(e, a, n, begin, end);
+}
+
+// x / 255 rounded to nearest for x <= 255 * 255
+inline unsigned div255(unsigned x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// n copies of the BGRX pixel c from dst
+inline void fill_span_scalar(uint8_t *dst, int n, const uint8_t *c)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        std::memcpy(dst + PIXEL_BYTES * i, c, PIXEL_BYTES);
+    }
+}
+
+/* blend a premultiplied BGRX color over n BGRX pixels
+ * src-over: dst = c + dst * (255 - a) / 255, additive: dst = min(dst + c, 255)
+ * the padding byte of c is 0, so the padding of dst stays 0 in both modes
+ */
+inline void blend_span_over_scalar(uint8_t *dst, int n, const uint8_t *c, uint8_t a)
+{
+    unsigned ia = 255 - a;
+    for (int i = 0; i < n; ++i, dst += PIXEL_BYTES)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            dst[k] = static_cast<uint8_t>(c[k] + div255(dst[k] * ia));
+        }
+    }
+}
+
+inline void blend_span_add_scalar(uint8_t *dst, int n, const uint8_t *c)
+{
+    for (int i = 0; i < n; ++i, dst += PIXEL_BYTES)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            dst[k] = static_cast<uint8_t>(std::min(255, dst[k] + c[k]));
+        }
+    }
+}
+
+// BGRX to packed BGR for n pixels
+inline void bgrx_to_bgr_scalar(const uint8_t *src, uint8_t *dst, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        std::memcpy(dst + 3 * i, src + PIXEL_BYTES * i, 3);
+    }
+}
+
+#if defined(GAMES_SIMD_X86)
+// a pixel in every 32 bit lane
+inline __m128i broadcast_sse2(const uint8_t *c)
+{
+    int32_t v;
+    std::memcpy(&v, c, PIXEL_BYTES);
+    return _mm_set1_epi32(v);
+}
+
+inline void fill_span_sse2(uint8_t *dst, int n, const uint8_t *c)
+{
+    const __m128i v = broadcast_sse2(c);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + PIXEL_BYTES * i), v);
+    }
+    fill_span_scalar(dst + PIXEL_BYTES * i, n - i, c);
+}
+
+GAMES_TARGET_AVX2 inline void fill_span_avx2(uint8_t *dst, int n, const uint8_t *c)
+{
+    int32_t v;
+    std::memcpy(&v, c, PIXEL_BYTES);
+    const __m256i p = _mm256_set1_epi32(v);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + PIXEL_BYTES * i), p);
+    }
+    fill_span_sse2(dst + PIXEL_BYTES * i, n - i, c);
+}
+
+inline __m128i div255_epu16(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+inline __m128i over_sse2(__m128i d, __m128i c, __m128i ia)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia));
+    __m128i hi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia));
+    return _mm_add_epi8(c, _mm_packus_epi16(lo, hi));
+}
+
+inline void blend_span_sse2(uint8_t *dst, int n, const uint8_t *c, uint8_t a, BlendMode mode)
+{
+    const __m128i pat = broadcast_sse2(c);
+    const __m128i ia = _mm_set1_epi16(static_cast<int16_t>(255 - a));
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(dst + PIXEL_BYTES * i);
+        __m128i d = _mm_loadu_si128(p);
+        d = mode == BlendMode::additive ? _mm_adds_epu8(d, pat) : over_sse2(d, pat, ia);
+        _mm_storeu_si128(p, d);
+    }
+    if (mode == BlendMode::additive)
+        blend_span_add_scalar(dst + PIXEL_BYTES * i, n - i, c);
+    else
+        blend_span_over_scalar(dst + PIXEL_BYTES * i, n - i, c, a);
+}
+
+GAMES_TARGET_AVX2 inline __m256i over_avx2(__m256i d, __m256i c, __m256i ia)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i half = _mm256_set1_epi16(128);
+    __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia), half);
+    __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia), half);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+    return _mm256_add_epi8(c, _mm256_packus_epi16(lo, hi));
+}
+
+GAMES_TARGET_AVX2 inline void blend_span_avx2(uint8_t *dst, int n, const uint8_t *c, uint8_t a, BlendMode mode)
+{
+    int32_t v;
+    std::memcpy(&v, c, PIXEL_BYTES);
+    const __m256i pat = _mm256_set1_epi32(v);
+    const __m256i ia = _mm256_set1_epi16(static_cast<int16_t>(255 - a));
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(dst + PIXEL_BYTES * i);
+        __m256i d = _mm256_loadu_si256(p);
+        d = mode == BlendMode::additive ? _mm256_adds_epu8(d, pat) : over_avx2(d, pat, ia);
+        _mm256_storeu_si256(p, d);
+    }
+    blend_span_sse2(dst + PIXEL_BYTES * i, n - i, c, a, mode);
+}
+
+// avx2 implies ssse3, the byte shuffle drops the padding of 4 pixels at a time
+GAMES_TARGET_AVX2 inline void bgrx_to_bgr_avx2(const uint8_t *src, uint8_t *dst, int n)
+{
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int i = 0;
+    // each store writes 16 bytes of which 12 are kept, so stop while 4 more bytes of dst remain
+    for (; i + 6 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + PIXEL_BYTES * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 3 * i), _mm_shuffle_epi8(v, pack));
+    }
+    bgrx_to_bgr_scalar(src + PIXEL_BYTES * i, dst + 3 * i, n - i);
+}
+#endif
+
+inline void fill_span(uint8_t *dst, int n, const uint8_t *c)
+{
+#if defined(GAMES_SIMD_X86)
+    switch (active_isa())
+    {
+        case isa::avx2: return fill_span_avx2(dst, n, c);
+        case isa::sse2: return fill_span_sse2(dst, n, c);
+        default: break;
+    }
+#endif
+    fill_span_scalar(dst, n, c);
+}
+
+/* fill w x h pixels of rows stride bytes apart with the BGRX color c
+ * the kernel is picked once for all rows, rows without a gap between them are filled as one span, and a color whose
+ * four bytes are equal is a memset, with the padding byte at 0 that is black
+ */
+inline void fill_rect(uint8_t *dst, std::ptrdiff_t stride, int w, int h, const uint8_t *c)
+{
+    if (w <= 0 || h <= 0)
+        return;
+    std::size_t row = PIXEL_BYTES * std::size_t(w);
+    if (std::ptrdiff_t(row) == stride)
+    {
+        row *= h;
+        w *= h;
+        h = 1;
+    }
+    if (c[0] == c[1] && c[0] == c[2] && c[0] == c[3])
+    {
+        for (int y = 0; y < h; ++y)
+        {
+            std::memset(dst + y * stride, c[0], row);
+        }
+        return;
+    }
+    void (*span)(uint8_t *, int, const uint8_t *) = fill_span_scalar;
+#if defined(GAMES_SIMD_X86)
+    switch (active_isa())
+    {
+        case isa::avx2: span = fill_span_avx2; break;
+        case isa::sse2: span = fill_span_sse2; break;
+        default: break;
+    }
+#endif
+    for (int y = 0; y < h; ++y)
+    {
+        span(dst + y * stride, w, c);
+    }
+}
+
+inline void blend_span(uint8_t *dst, int n, const uint8_t *c, uint8_t a, BlendMode mode)
+{
+#if defined(GAMES_SIMD_X86)
+    switch (active_isa())
+    {
+        case isa::avx2: return blend_span_avx2(dst, n, c, a, mode);
+        case isa::sse2: return blend_span_sse2(dst, n, c, a, mode);
+        default: break;
+    }
+#endif
+    if (mode == BlendMode::additive)
+        blend_span_add_scalar(dst, n, c);
+    else
+        blend_span_over_scalar(dst, n, c, a);
+}
+
+inline void bgrx_to_bgr(const uint8_t *src, uint8_t *dst, int n)
+{
+#if defined(GAMES_SIMD_X86)
+    if (active_isa() == isa::avx2)
+        return bgrx_to_bgr_avx2(src, dst, n);
+#endif
+    bgrx_to_bgr_scalar(src, dst, n);
+}
+
+} // end namespace simd
+
+} // end namespace games
+
+#endif // GAMES_SIMD_HPP
@@ -0,0 +1,120 @@
+#pragma once
+#ifndef GAMES_THREAD_POOL_HPP
+#define GAMES_THREAD_POOL_HPP
+
+#include "profiler.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace games
+{
+
+// fixed set of workers for fork-join loops, the calling thread takes part in every loop
+class ThreadPool
+{
+  private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_mtx;
+    std::condition_variable m_cv_start;
+    std::condition_variable m_cv_done;
+    std::function<void(int)> m_job;
+    std::atomic<int> m_next{0};
+    int m_end = 0;
+    int m_busy = 0;
+    unsigned m_generation = 0;
+    bool m_stop = false;
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void run_job()
+    {
+        for (int i = m_next.fetch_add(1); i < m_end; i = m_next.fetch_add(1))
+        {
+            m_job(i);
+        }
+    }
+
+    void worker_loop()
+    {
+        prof::set_thread_name("worker");
+        unsigned seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mtx);
+                m_cv_start.wait(lock, [&] { return m_stop || m_generation != seen; });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+            }
+            {
+                ScopedTimer timer(Phase::worker);
+                run_job();
+            }
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (--m_busy == 0)
+                m_cv_done.notify_one();
+        }
+    }
+
+  public:
+    // threads counts the calling thread, ThreadPool(1) runs everything inline
+    explicit ThreadPool(int threads)
+    {
+        for (int i = 1; i < threads; ++i)
+        {
+            m_workers.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_stop = true;
+        }
+        m_cv_start.notify_all();
+        for (auto &t : m_workers)
+        {
+            t.join();
+        }
+    }
+
+    int size() const { return static_cast<int>(m_workers.size()) + 1; }
+
+    // call f(i) for every i in [begin, end) and wait until all calls returned
+    template <typename F>
+    void parallel_for(int begin, int end, F &&f)
+    {
+        if (m_workers.empty() || end - begin <= 1)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                f(i);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_job = [&f](int i) { f(i); };
+            m_next = begin;
+            m_end = end;
+            m_busy = static_cast<int>(m_workers.size());
+            ++m_generation;
+        }
+        m_cv_start.notify_all();
+        run_job();
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv_done.wait(lock, [&] { return m_busy == 0; });
+        m_job = nullptr;
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_THREAD_POOL_HPP
@@ -29,8 +29,8 @@ concept complex = is_complex_v<T>;
 template <typename T>
 concept scalar = arithmetic<T> || complex<T>;
 
-auto deg2rad(arithmetic auto deg) { return deg * 3.14159265358979323846 / 180.0; }
-auto rad2deg(arithmetic auto rad) { return rad * 180.0 / 3.14159265358979323846; }
+constexpr auto deg2rad(arithmetic auto deg) { return deg * 3.14159265358979323846 / 180.0; }
+constexpr auto rad2deg(arithmetic auto rad) { return rad * 180.0 / 3.14159265358979323846; }
 
 template <arithmetic T>
 constexpr auto normalize_deg(T deg)
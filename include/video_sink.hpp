@@ -0,0 +1,191 @@
+#pragma once
+#ifndef GAMES_VIDEO_SINK_HPP
+#define GAMES_VIDEO_SINK_HPP
+
+#include "raw_canvas.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace games
+{
+
+enum class VideoFormat
+{
+    y4m,   // YUV4MPEG2 4:2:0, BT.601 studio range, readable by ffmpeg and most encoders
+    rgb24, // headerless packed R, G, B, e.g. ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i -
+};
+
+/* streams frames into one file or pipe, each frame is converted into a staging buffer and written by a single call
+ * frame sized writes bypass the stdio buffer, files opened by the sink get a large one for small frames
+ */
+class VideoSink : public FrameSink
+{
+  private:
+    static constexpr std::size_t IO_BUFFER = std::size_t(1) << 20;
+
+    std::FILE *m_file;
+    bool m_owned;
+    bool m_ok;
+    VideoFormat m_format;
+    int m_fps;
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<char> m_io;
+    std::vector<uint8_t> m_frame;
+
+    VideoSink(const VideoSink &) = delete;
+    VideoSink &operator=(const VideoSink &) = delete;
+
+    static uint8_t luma(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+    static uint8_t chroma_u(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+    static uint8_t chroma_v(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+    // "FRAME\n" and the Y, U and V planes, chroma from the mean of each 2 x 2 block
+    void convert_y4m(const frame_view &f)
+    {
+        static constexpr char tag[] = "FRAME\n";
+        const int cw = (f.width + 1) / 2;
+        const int ch = (f.height + 1) / 2;
+        uint8_t *out = m_frame.data();
+        std::memcpy(out, tag, sizeof(tag) - 1);
+        uint8_t *py = out + sizeof(tag) - 1;
+        uint8_t *pu = py + f.width * f.height;
+        uint8_t *pv = pu + cw * ch;
+        for (int y = 0; y < f.height; ++y)
+        {
+            const uint8_t *row = f.pixels + y * f.stride;
+            for (int x = 0; x < f.width; ++x)
+            {
+                const uint8_t *p = row + simd::PIXEL_BYTES * x;
+                py[y * f.width + x] = luma(p[2], p[1], p[0]);
+            }
+        }
+        for (int cy = 0; cy < ch; ++cy)
+        {
+            const uint8_t *row0 = f.pixels + 2 * cy * f.stride;
+            const uint8_t *row1 = 2 * cy + 1 < f.height ? row0 + f.stride : row0;
+            for (int cx = 0; cx < cw; ++cx)
+            {
+                int x0 = simd::PIXEL_BYTES * 2 * cx;
+                int x1 = 2 * cx + 1 < f.width ? x0 + simd::PIXEL_BYTES : x0;
+                int sum[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    sum[k] = (row0[x0 + k] + row0[x1 + k] + row1[x0 + k] + row1[x1 + k] + 2) >> 2;
+                }
+                pu[cy * cw + cx] = chroma_u(sum[2], sum[1], sum[0]);
+                pv[cy * cw + cx] = chroma_v(sum[2], sum[1], sum[0]);
+            }
+        }
+    }
+
+    void convert_rgb24(const frame_view &f)
+    {
+        uint8_t *out = m_frame.data();
+        for (int y = 0; y < f.height; ++y)
+        {
+            const uint8_t *p = f.pixels + y * f.stride;
+            for (int x = 0; x < f.width; ++x, p += simd::PIXEL_BYTES, out += 3)
+            {
+                out[0] = p[2];
+                out[1] = p[1];
+                out[2] = p[0];
+            }
+        }
+    }
+
+    // the stream header and staging buffer follow the size of the first frame
+    void start(int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        if (m_format == VideoFormat::y4m)
+        {
+            std::fprintf(m_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, m_fps);
+            m_frame.resize(sizeof("FRAME\n") - 1 + width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+        }
+        else
+            m_frame.resize(3 * width * height);
+    }
+
+  public:
+    // path "-" streams to stdout, for example into an encoder reading from a pipe
+    VideoSink(const char *path, VideoFormat format, int fps = 60)
+        : m_file(nullptr), m_owned(std::strcmp(path, "-") != 0), m_format(format), m_fps(fps),
+          m_io(m_owned ? IO_BUFFER : 0)
+    {
+        if (m_owned)
+            m_file = std::fopen(path, "wb");
+        else
+        {
+#ifdef _WIN32
+            ::_setmode(::_fileno(stdout), _O_BINARY);
+#endif
+            m_file = stdout;
+        }
+        m_ok = m_file != nullptr;
+        if (m_ok && m_owned)
+            std::setvbuf(m_file, m_io.data(), _IOFBF, m_io.size());
+    }
+
+    // write into an already open stream such as a popen pipe, the caller keeps ownership
+    VideoSink(std::FILE *file, VideoFormat format, int fps = 60)
+        : m_file(file), m_owned(false), m_ok(file != nullptr), m_format(format), m_fps(fps)
+    {}
+
+    ~VideoSink()
+    {
+        if (!m_file)
+            return;
+        if (m_owned)
+            std::fclose(m_file);
+        else
+            std::fflush(m_file);
+    }
+
+    // false once opening or a write failed, later frames are dropped
+    bool ok() const { return m_ok; }
+
+    void write_frame(const frame_view &frame) override
+    {
+        if (!m_ok)
+            return;
+        if (m_width == 0)
+            start(frame.width, frame.height);
+        if (frame.width != m_width || frame.height != m_height)
+        {
+            m_ok = false;
+            return;
+        }
+        if (m_format == VideoFormat::y4m)
+            convert_y4m(frame);
+        else
+            convert_rgb24(frame);
+        m_ok = std::fwrite(m_frame.data(), 1, m_frame.size(), m_file) == m_frame.size();
+    }
+
+    void flush()
+    {
+        if (m_file)
+            std::fflush(m_file);
+    }
+};
+
+} // end namespace games
+
+#endif // GAMES_VIDEO_SINK_HPP
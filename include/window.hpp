@@ -8,13 +8,12 @@
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
+#include "profiler.hpp"
+#include "raw_canvas.hpp"
 #include <Windows.h>
 #include <algorithm>
-#include <cstdint>
 #include <cstdio>
-#include <cstring>
-#include <fstream>
-#include <mutex>
+#include <limits>
 
 namespace games
 {
@@ -63,109 +62,6 @@ class Application
     }
 };
 
-class RawCanvas
-{
-  private:
-    BITMAPINFO m_bmi;
-    uint8_t *m_pixels;
-    uint8_t *m_pixels_show;
-    int m_width;
-    int m_height;
-    std::mutex m_mtx;
-
-  public:
-    RawCanvas(int width, int height) : m_width(width), m_height(height)
-    {
-        m_bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-        m_bmi.bmiHeader.biWidth = width;
-        m_bmi.bmiHeader.biHeight = -height;
-        m_bmi.bmiHeader.biPlanes = 1;
-        m_bmi.bmiHeader.biBitCount = 24;
-        m_bmi.bmiHeader.biCompression = BI_RGB;
-        m_bmi.bmiHeader.biSizeImage = 0;
-        m_bmi.bmiHeader.biXPelsPerMeter = 0;
-        m_bmi.bmiHeader.biYPelsPerMeter = 0;
-        m_bmi.bmiHeader.biClrUsed = 0;
-        m_bmi.bmiHeader.biClrImportant = 0;
-        m_pixels = new uint8_t[3 * width * height];
-        m_pixels_show = new uint8_t[3 * width * height];
-    }
-
-    ~RawCanvas()
-    {
-        delete[] m_pixels;
-        delete[] m_pixels_show;
-    }
-
-    uint8_t *raw_pixel(int x, int y) { return m_pixels + 3 * (y * m_width + x); }
-    const uint8_t *raw_pixel(int x, int y) const { return m_pixels + 3 * (y * m_width + x); }
-
-    void get_pixel(int x, int y, uint8_t &r, uint8_t &g, uint8_t &b) const
-    {
-        const uint8_t *p = raw_pixel(x, y);
-        b = p[0];
-        g = p[1];
-        r = p[2];
-    }
-
-    void set_pixel(int x, int y, uint8_t r, uint8_t g, uint8_t b)
-    {
-        uint8_t *p = raw_pixel(x, y);
-        p[0] = b;
-        p[1] = g;
-        p[2] = r;
-    }
-
-    void fill(uint8_t r, uint8_t g, uint8_t b)
-    {
-        for (int i = 0; i < m_width * m_height; ++i)
-        {
-            uint8_t *p = m_pixels + 3 * i;
-            p[0] = b;
-            p[1] = g;
-            p[2] = r;
-        }
-    }
-
-    int width() const { return m_width; }
-    int height() const { return m_height; }
-    void save_bmp(const char *fname) const
-    {
-        BITMAPFILEHEADER bfh;
-        bfh.bfType = 0x4d42;
-        bfh.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + 3 * m_width * m_height;
-        bfh.bfReserved1 = 0;
-        bfh.bfReserved2 = 0;
-        bfh.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
-        std::ofstream fp(fname, std::ios::binary);
-        fp.write(reinterpret_cast<const char *>(&bfh), sizeof(BITMAPFILEHEADER));
-        fp.write(reinterpret_cast<const char *>(&m_bmi.bmiHeader), sizeof(BITMAPINFOHEADER));
-        fp.write(reinterpret_cast<const char *>(m_pixels), 3 * m_width * m_height);
-    }
-
-    void beginpaint() {}
-
-    void endpaint()
-    {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        std::memcpy(m_pixels_show, m_pixels, 3 * m_width * m_height);
-    }
-
-    void to_dc(HDC hdc, int width, int height)
-    {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        if (width == m_width && height == m_height)
-        {
-            ::SetDIBitsToDevice(hdc, 0, 0, width, height, 0, 0, 0, m_height, m_pixels_show, &m_bmi, DIB_RGB_COLORS);
-        }
-        else
-        {
-            ::StretchDIBits(hdc, 0, 0, width, height, 0, 0, m_width, m_height, m_pixels_show, &m_bmi, DIB_RGB_COLORS,
-                            SRCCOPY);
-        }
-    }
-};
-
 /* modified from Microsoft's Direct2D tutorial code
  * url:
  * https://github.com/microsoft/Windows-classic-samples/blob/main/Samples/Win7Samples/begin/LearnWin32/Direct2DCircle/cpp/basewin.h
@@ -379,6 +275,7 @@ class MainWindow : public BaseWindow<MainWindow>
 
     LRESULT on_paint()
     {
+        ScopedTimer timer(Phase::paint);
         PAINTSTRUCT ps;
         auto hdc = ::BeginPaint(m_hwnd, &ps);
         RECT rc;
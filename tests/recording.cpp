@@ -0,0 +1,203 @@
+#include "canvas.hpp"
+#include "recording.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace games;
+
+/* usage: recording [--dir=path]
+ * renders a short animation with both anti-aliasing modes into <dir>/recording_<aa>.grec while keeping a copy of
+ * every published frame, then replays the recording forward, backward, and from a copy cut before its index
+ * every replayed frame has to match the live frame byte for byte, the recordings are removed when they do
+ * exits with 0 when every frame matched and 1 otherwise
+ */
+
+namespace
+{
+
+constexpr int WIDTH = 200; // not a multiple of the tile size, so partial tiles are covered too
+constexpr int HEIGHT = 130;
+constexpr int FRAMES = 24;
+constexpr int KEY_INTERVAL = 8; // seeks decode deltas from a key frame several frames back
+
+using frame = std::vector<uint8_t>; // packed BGR
+
+// forwards every frame to the recorder and keeps a copy
+struct capture_sink : FrameSink
+{
+    FrameSink &next;
+    std::vector<frame> frames;
+
+    explicit capture_sink(FrameSink &next) : next(next) {}
+
+    void write_frame(const frame_view &f) override
+    {
+        frame &copy = frames.emplace_back(3 * std::size_t(f.width) * f.height);
+        for (int y = 0; y < f.height; ++y)
+        {
+            const uint8_t *src = f.pixels + y * f.stride;
+            uint8_t *dst = copy.data() + 3 * std::size_t(y) * f.width;
+            for (int x = 0; x < f.width; ++x, src += simd::PIXEL_BYTES, dst += 3)
+            {
+                std::memcpy(dst, src, 3);
+            }
+        }
+        next.write_frame(f);
+    }
+};
+
+// moving shapes over a background that changes every few frames, some frames repeat the previous one
+void render(Canvas &c, int i)
+{
+    c.beginpaint();
+    c.fill(i / 10 % 2 ? rgb{30, 30, 40} : rgb{60, 20, 20});
+    int t = i % 6 == 5 ? i - 1 : i;
+    float x = 20 + 7.5f * t, y = 65 + 40 * std::sin(t * 0.4f);
+    c.fill(geo2d::circle(x, y, 18), rgb{240, 200, 40});
+    c.draw(geo2d::circle(WIDTH - x, HEIGHT - y, 12), 3, rgba::from_opacity(rgb{80, 200, 255}, 0.6));
+    c.fill(geo2d::rect(20, 50, 100, 30 + 2.0f * t, 0.1f * t), rgb{70, 110, 230});
+    c.draw(geo2d::polyline({{10, 120}, {x, y}, {190, 10 + 3.0f * t}}), stroke_style{4, LineJoin::round, LineCap::round},
+           rgba::from_opacity(rgb{20, 220, 90}, 0.8));
+    c.endpaint();
+}
+
+int compare(FrameReplayer &replay, const std::vector<frame> &live, const std::vector<int> &order, const char *what)
+{
+    RawCanvas canvas(WIDTH, HEIGHT);
+    for (int i : order)
+    {
+        if (!replay.read_frame(i, canvas))
+        {
+            std::printf("FAIL %-28s frame %d could not be read\n", what, i);
+            return 1;
+        }
+        for (int y = 0; y < HEIGHT; ++y)
+        {
+            const uint8_t *src = canvas.raw_pixel(0, y);
+            const uint8_t *expected = live[i].data() + 3 * std::size_t(y) * WIDTH;
+            for (int x = 0; x < WIDTH; ++x, src += simd::PIXEL_BYTES, expected += 3)
+            {
+                if (std::memcmp(src, expected, 3) != 0)
+                {
+                    std::printf("FAIL %-28s frame %d differs at (%d, %d)\n", what, i, x, y);
+                    return 1;
+                }
+            }
+        }
+    }
+    std::printf("     %-28s %zu frames\n", what, order.size());
+    return 0;
+}
+
+bool read_file(const std::string &path, std::vector<uint8_t> &bytes)
+{
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    uint8_t buffer[1 << 16];
+    for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), f)) > 0;)
+    {
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+    std::fclose(f);
+    return true;
+}
+
+bool write_file(const std::string &path, const uint8_t *bytes, std::size_t n)
+{
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = std::fwrite(bytes, 1, n, f) == n;
+    return std::fclose(f) == 0 && ok;
+}
+
+int run(AntiAlias aa, const std::string &dir)
+{
+    const std::string name = aa == AntiAlias::supersample ? "recording_ss4" : "recording_cov";
+    const std::string path = dir + "/" + name + ".grec";
+    std::vector<frame> live;
+    {
+        FrameRecorder recorder(path.c_str(), KEY_INTERVAL);
+        capture_sink sink(recorder);
+        Canvas canvas(WIDTH, HEIGHT, aa);
+        canvas.get_raw_canvas().set_sink(&sink);
+        for (int i = 0; i < FRAMES; ++i)
+        {
+            render(canvas, i);
+        }
+        recorder.close();
+        if (!recorder.ok() || recorder.frames() != FRAMES || sink.frames.size() != FRAMES)
+        {
+            std::printf("FAIL %-28s recording %s failed\n", name.c_str(), path.c_str());
+            return 1;
+        }
+        live = std::move(sink.frames);
+    }
+
+    int failed = 0;
+    std::vector<int> forward, backward;
+    for (int i = 0; i < FRAMES; ++i)
+    {
+        forward.push_back(i);
+        backward.push_back(FRAMES - 1 - i);
+    }
+    {
+        FrameReplayer replay(path.c_str());
+        if (!replay.ok() || replay.frames() != FRAMES || replay.width() != WIDTH || replay.height() != HEIGHT)
+        {
+            std::printf("FAIL %-28s %s does not replay\n", name.c_str(), path.c_str());
+            return 1;
+        }
+        failed += compare(replay, live, forward, (name + " forward").c_str());
+        failed += compare(replay, live, backward, (name + " backward").c_str());
+    }
+
+    // a recording that was not closed has no index, the replayer walks the frames instead
+    std::vector<uint8_t> bytes;
+    const std::string unindexed = dir + "/" + name + "_unindexed.grec";
+    if (!read_file(path, bytes) || bytes.size() < rec::TRAILER_BYTES ||
+        !write_file(unindexed, bytes.data(), rec::get_u64(bytes.data() + bytes.size() - rec::TRAILER_BYTES)))
+    {
+        std::printf("FAIL %-28s could not cut the index off %s\n", name.c_str(), path.c_str());
+        return 1;
+    }
+    FrameReplayer replay(unindexed.c_str());
+    if (!replay.ok() || replay.frames() != FRAMES)
+    {
+        std::printf("FAIL %-28s %s does not replay\n", name.c_str(), unindexed.c_str());
+        return 1;
+    }
+    failed += compare(replay, live, forward, (name + " unindexed").c_str());
+    if (failed == 0)
+    {
+        std::remove(path.c_str());
+        std::remove(unindexed.c_str());
+    }
+    return failed;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string dir = ".";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--dir=", 6) == 0)
+            dir = argv[i] + 6;
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--dir=path]\n", argv[0]);
+            return 1;
+        }
+    }
+    int failed = run(AntiAlias::supersample, dir) + run(AntiAlias::coverage, dir);
+    std::printf("%s\n", failed ? "failed" : "passed");
+    return failed ? 1 : 0;
+}